@@ -0,0 +1,99 @@
+// Compares the cost of dispatching through cr::AnyExecutor with that of the concrete executors.
+// Build with -Dcrhandle_build_benchmarks=ON in a release configuration and run bench_anyexecutor.
+
+#include "crhandle/anyexecutor.hpp"
+#include "crhandle/prioritydispatcher.hpp"
+#include "crhandle/taskhandle.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+namespace {
+
+constexpr std::size_t Iterations = 1'000'000;
+
+// Executor that only counts, so that the measurement is dominated by the dispatch itself. The
+// counter is volatile to keep the compiler from folding the loop.
+struct CountingExecutor
+{
+   volatile std::size_t * count = nullptr;
+
+   template <typename F>
+   void Execute(F &&) const noexcept
+   {
+      *count = *count + 1;
+   }
+};
+
+template <typename F>
+void Measure(const char * name, F && body)
+{
+   const auto start = std::chrono::steady_clock::now();
+   body();
+   const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+   std::printf("%-40s %8.2f ns/op\n", name, elapsed.count() / Iterations);
+}
+
+template <cr::Executor E>
+void PostHandles(const char * name, E executor)
+{
+   Measure(name, [&] {
+      for (std::size_t i = 0; i < Iterations; ++i)
+         executor.Execute(stdcr::noop_coroutine());
+   });
+}
+
+template <cr::Executor E>
+cr::TaskHandle<int, E> Child(int i)
+{
+   co_return i;
+}
+
+template <cr::Executor E>
+cr::TaskHandle<void, E> Parent(std::size_t & sum)
+{
+   for (std::size_t i = 0; i < Iterations; ++i)
+      sum += static_cast<std::size_t>(co_await Child<E>(static_cast<int>(i & 1)));
+}
+
+template <cr::Executor E, typename Drain>
+void AwaitChildren(const char * name, E executor, Drain drain)
+{
+   std::size_t sum = 0;
+   Measure(name, [&] {
+      auto task = Parent<E>(sum);
+      task.Run(executor);
+      drain();
+   });
+   if (sum != Iterations / 2)
+      std::printf("unexpected result %zu\n", sum);
+}
+
+} // namespace
+
+int main()
+{
+   volatile std::size_t count = 0;
+   PostHandles("post handle, CountingExecutor", CountingExecutor{&count});
+   PostHandles("post handle, AnyExecutor(Counting)", cr::AnyExecutor(CountingExecutor{&count}));
+
+   cr::PriorityDispatcher dispatcher;
+   PostHandles("post handle, PriorityDispatcher", dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   PostHandles("post handle, AnyExecutor(Priority)", cr::AnyExecutor(dispatcher.GetExecutor()));
+   dispatcher.ProcessAll();
+
+   auto drain = [&] {
+      dispatcher.ProcessAll();
+   };
+   auto noDrain = [] {};
+   AwaitChildren("await child, InlineExecutor", cr::InlineExecutor{}, noDrain);
+   AwaitChildren("await child, AnyExecutor(Inline)", cr::AnyExecutor{}, noDrain);
+   AwaitChildren("await child, PriorityDispatcher", dispatcher.GetExecutor(), drain);
+   AwaitChildren("await child, AnyExecutor(Priority)",
+                 cr::AnyExecutor(dispatcher.GetExecutor()),
+                 drain);
+   return count == 2 * Iterations ? 0 : 1;
+}
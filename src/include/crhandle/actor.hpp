@@ -0,0 +1,327 @@
+#ifndef ACTOR_HPP
+#define ACTOR_HPP
+
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/unichannel.hpp"
+#include "crhandle/uniquefunction.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cr {
+
+template <typename R>
+class Reply;
+
+template <typename Msg, Executor E>
+class Actor;
+
+namespace internal {
+
+// Lives in the awaiter of an Actor::Ask(), the Reply inside the message points to it. The asker
+// goes to sleep only if the reply hasn't arrived while it was still posting the message, e.g. from
+// an actor running on an inline executor; whichever side comes second lets it continue.
+template <typename R>
+struct ReplySlot
+{
+   enum State : unsigned char
+   {
+      Suspending,
+      Suspended,
+      Completed,
+   };
+
+   // False if the reply is already there and the asker must not suspend
+   bool FinishSuspend() noexcept
+   {
+      State expected = Suspending;
+      return state.compare_exchange_strong(expected, Suspended, std::memory_order_acq_rel);
+   }
+
+   void Complete()
+   {
+      if (state.exchange(Completed, std::memory_order_acq_rel) == Suspended) {
+         // the asker may be gone as soon as it has been resumed
+         UniqueFunction resume = std::move(resumer);
+         resume();
+      }
+   }
+
+   std::optional<R> value;
+   UniqueFunction resumer;
+   std::atomic<State> state = Suspending;
+};
+
+template <typename R, typename Msg, Executor E, typename F>
+class AskAwaiter
+{
+public:
+   AskAwaiter(Actor<Msg, E> & actor, F makeMessage)
+      : m_actor(actor)
+      , m_makeMessage(std::move(makeMessage))
+   {}
+
+   AskAwaiter(AskAwaiter && other) noexcept
+      : m_actor(other.m_actor)
+      , m_makeMessage(std::move(other.m_makeMessage))
+   {
+      assert(!other.m_slot.resumer);
+   }
+
+   bool await_ready() const noexcept { return false; }
+
+   template <typename P>
+   bool await_suspend(stdcr::coroutine_handle<P> h)
+   {
+      m_slot.resumer = MakeResumer(h);
+      // a message the mailbox refuses is dropped right here and its Reply completes the slot
+      m_actor.Tell(std::invoke(m_makeMessage, Reply<R>(&m_slot)));
+      return m_slot.FinishSuspend();
+   }
+
+   R await_resume()
+   {
+      if (!m_slot.value)
+         throw CanceledException{};
+      return std::move(*m_slot.value);
+   }
+
+private:
+   Actor<Msg, E> & m_actor;
+   F m_makeMessage;
+   ReplySlot<R> m_slot;
+};
+
+} // namespace internal
+
+// Answer to an Actor::Ask(), carried inside the message to the handler. Send() resumes the asker
+// on its own executor. A Reply destroyed without having been sent makes the Ask throw
+// CanceledException, so an asker is never left hanging by a dropped message.
+template <typename R>
+class Reply
+{
+public:
+   Reply(Reply && other) noexcept
+      : m_slot(std::exchange(other.m_slot, nullptr))
+   {}
+
+   Reply & operator=(Reply && other) noexcept
+   {
+      if (this != &other) {
+         Abandon();
+         m_slot = std::exchange(other.m_slot, nullptr);
+      }
+      return *this;
+   }
+
+   ~Reply() { Abandon(); }
+
+   // False once the value has been sent
+   explicit operator bool() const noexcept { return m_slot != nullptr; }
+
+   void Send(R value)
+   {
+      assert(m_slot);
+      internal::ReplySlot<R> * slot = std::exchange(m_slot, nullptr);
+      slot->value.emplace(std::move(value));
+      slot->Complete();
+   }
+
+private:
+   template <typename, typename, Executor, typename>
+   friend class internal::AskAwaiter;
+
+   explicit Reply(internal::ReplySlot<R> * slot) noexcept
+      : m_slot(slot)
+   {}
+
+   void Abandon()
+   {
+      if (m_slot)
+         std::exchange(m_slot, nullptr)->Complete();
+   }
+
+   internal::ReplySlot<R> * m_slot;
+};
+
+// One coroutine that owns some state and handles the messages sent to its Unichannel mailbox one
+// at a time. The handler is called as handler(Msg&&) and returns void or a TaskHandle<void, E> to
+// await before the next message. Everything runs on the executor, so on a serial one, e.g. a Strand
+// over a thread pool, state touched only by the handler needs no lock. Each wakeup of the loop
+// takes up to MaxBatch queued messages at once instead of going through Receive() for every one.
+//
+// Stop() closes the mailbox, the loop still handles what was sent before. Destroying the Actor
+// also cancels the loop, messages it hasn't handled yet are dropped and their asks canceled. An
+// exception from the handler closes the mailbox, drops the messages still queued the same way and
+// is rethrown by EnsureNoException().
+template <typename Msg, Executor E = InlineExecutor>
+class Actor
+{
+public:
+   static constexpr std::size_t MaxBatch = 64;
+
+   struct MailboxStats
+   {
+      std::size_t size = 0;         // sent but not handled yet, including the current message
+      std::size_t maxSize = 0;      // highest size seen so far
+      std::uint64_t processed = 0;
+   };
+
+   template <typename H>
+      requires std::invocable<H &, Msg &&>
+   Actor(E executor, H handler)
+      : m_state(std::make_shared<State>(executor))
+      , m_producer(m_state->channel)
+      , m_loop(Loop(m_state, std::move(handler)))
+   {
+      m_loop.Run(std::move(executor));
+   }
+
+   template <typename H>
+      requires std::invocable<H &, Msg &&>
+   explicit Actor(H handler)
+      : Actor(E{}, std::move(handler))
+   {}
+
+   Actor(Actor &&) noexcept = default;
+   Actor & operator=(Actor &&) noexcept = default;
+
+   ~Actor()
+   {
+      if (m_state)
+         m_producer.Close();
+   }
+
+   // Returns false if the mailbox has been closed
+   bool Tell(Msg msg)
+   {
+      m_state->Enqueued();
+      if (m_producer.Send(std::move(msg)))
+         return true;
+      m_state->Dropped(1);
+      return false;
+   }
+
+   // Sends makeMessage(Reply<R>) and returns an awaitable for the value the handler sends back
+   // through the Reply. The reply slot lives in the awaiter, so apart from the message itself an
+   // Ask allocates nothing. Throws CanceledException if the mailbox is closed or the Reply dropped.
+   template <typename R, typename F>
+      requires std::is_invocable_r_v<Msg, F &, Reply<R>>
+   auto Ask(F makeMessage)
+   {
+      return internal::AskAwaiter<R, Msg, E, F>(*this, std::move(makeMessage));
+   }
+
+   void Stop() { m_producer.Close(); }
+
+   // True until the loop has finished after Stop() or an exception
+   bool Running() const noexcept { return static_cast<bool>(m_loop); }
+
+   void EnsureNoException() { m_loop.EnsureNoException(); }
+
+   MailboxStats Stats() const noexcept
+   {
+      return {m_state->mailboxSize.load(std::memory_order_relaxed),
+              m_state->maxMailboxSize.load(std::memory_order_relaxed),
+              m_state->processed.load(std::memory_order_relaxed)};
+   }
+
+private:
+   using Channel = Unichannel<Msg, E>;
+
+   // Shared with the loop, which may outlive the Actor until its cancellation has gone through
+   struct State
+   {
+      explicit State(E executor)
+         : channel(Channel::Make(std::move(executor)))
+      {}
+
+      void Enqueued() noexcept
+      {
+         const std::size_t size = mailboxSize.fetch_add(1, std::memory_order_relaxed) + 1;
+         std::size_t max = maxMailboxSize.load(std::memory_order_relaxed);
+         while (max < size &&
+                !maxMailboxSize.compare_exchange_weak(max, size, std::memory_order_relaxed)) {
+         }
+      }
+
+      void Handled() noexcept
+      {
+         mailboxSize.fetch_sub(1, std::memory_order_relaxed);
+         processed.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      void Dropped(std::size_t count) noexcept
+      {
+         mailboxSize.fetch_sub(count, std::memory_order_relaxed);
+      }
+
+      std::shared_ptr<Channel> channel;
+      std::atomic<std::size_t> mailboxSize = 0;
+      std::atomic<std::size_t> maxMailboxSize = 0;
+      std::atomic<std::uint64_t> processed = 0;
+   };
+
+   // Refuses further messages once the loop has ended, however it ended
+   struct LoopExit
+   {
+      typename Channel::Producer producer;
+      ~LoopExit() { producer.Close(); }
+   };
+
+   template <typename H>
+   static TaskHandle<void, E> Loop(std::shared_ptr<State> state, H handler)
+   {
+      LoopExit exit{typename Channel::Producer(state->channel)};
+      std::vector<Msg> batch;
+      std::size_t next = 0;
+      std::exception_ptr failure;
+      try {
+         while (auto first = co_await state->channel->Receive()) {
+            batch.push_back(std::move(*first));
+            state->channel->TakeReady(batch, MaxBatch - 1);
+            for (next = 0; next < batch.size(); ++next) {
+               Msg & msg = batch[next];
+               if constexpr (requires { typename std::invoke_result_t<H &, Msg &&>::promise_type; })
+                  co_await std::invoke(handler, std::move(msg));
+               else
+                  std::invoke(handler, std::move(msg));
+               state->Handled();
+            }
+            batch.clear();
+         }
+      }
+      catch (...) {
+         failure = std::current_exception();
+      }
+      if (!failure)
+         co_return;
+
+      // Drop everything that won't be handled now, so that the asks among it are canceled rather
+      // than left waiting for the Actor to be destroyed
+      state->Dropped(batch.size() - next);
+      batch.clear();
+      exit.producer.Close();
+      while (co_await state->channel->Receive())
+         state->Dropped(1);
+      std::rethrow_exception(failure);
+   }
+
+   std::shared_ptr<State> m_state;
+   typename Channel::Producer m_producer;
+   TaskHandle<void, E> m_loop;
+};
+
+} // namespace cr
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef ANYEXECUTOR_HPP
+#define ANYEXECUTOR_HPP
+
+#include "crhandle/coroutine.hpp"
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/uniquefunction.hpp"
+
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+namespace cr {
+
+// Type-erased executor, so that code using several executor types shares one set of TaskHandle,
+// Unichannel etc. instantiations at the cost of an indirect call per post. The wrapped executor is
+// stored in place and must fit into InlineSize, thus AnyExecutor never allocates by itself.
+// Coroutine handles and batches are passed on as they are, other callables are wrapped in a
+// UniqueFunction first. Expired(), ShouldYield(), RunningInThisThread() and equality of the wrapped
+// executor are forwarded. A default-constructed AnyExecutor wraps an InlineExecutor, but nested
+// tasks don't get the synchronous fast path that Promise has for a plain InlineExecutor.
+class AnyExecutor
+{
+public:
+   static constexpr std::size_t InlineSize = 2 * sizeof(void *);
+
+   AnyExecutor() noexcept
+      : AnyExecutor(InlineExecutor{})
+   {}
+
+   template <Executor E>
+      requires(!std::is_same_v<std::remove_cvref_t<E>, AnyExecutor>)
+   AnyExecutor(E executor) noexcept
+   {
+      static_assert(sizeof(E) <= InlineSize && alignof(E) <= alignof(void *),
+                    "executor is too large to be stored in place");
+      static_assert(std::is_nothrow_copy_constructible_v<E>);
+      ::new (m_storage) E(std::move(executor));
+      m_ops = &s_ops<E>;
+   }
+
+   AnyExecutor(const AnyExecutor & other) noexcept
+      : m_ops(other.m_ops)
+   {
+      m_ops->copy(other.m_storage, m_storage);
+   }
+
+   AnyExecutor & operator=(const AnyExecutor & other) noexcept
+   {
+      if (this != &other) {
+         m_ops->destroy(m_storage);
+         m_ops = other.m_ops;
+         m_ops->copy(other.m_storage, m_storage);
+      }
+      return *this;
+   }
+
+   ~AnyExecutor() { m_ops->destroy(m_storage); }
+
+   template <typename F>
+   void Execute(F && f)
+   {
+      if constexpr (std::is_convertible_v<F, stdcr::coroutine_handle<>>)
+         m_ops->executeHandle(m_storage, std::forward<F>(f));
+      else
+         m_ops->execute(m_storage, internal::UniqueFunction(std::forward<F>(f)));
+   }
+
+   void ExecuteBatch(std::span<stdcr::coroutine_handle<>> handles)
+   {
+      m_ops->executeBatch(m_storage, handles);
+   }
+
+   bool Expired() const noexcept { return m_ops->expired && m_ops->expired(m_storage); }
+   bool ShouldYield() const noexcept { return m_ops->shouldYield && m_ops->shouldYield(m_storage); }
+   bool RunningInThisThread() const noexcept
+   {
+      return m_ops->runningInThisThread && m_ops->runningInThisThread(m_storage);
+   }
+
+   // Returns nullptr if E isn't the type of the wrapped executor
+   template <Executor E>
+   const E * Target() const noexcept
+   {
+      if (m_ops != &s_ops<E>)
+         return nullptr;
+      return std::launder(reinterpret_cast<const E *>(m_storage));
+   }
+
+   friend bool operator==(const AnyExecutor & lhs, const AnyExecutor & rhs) noexcept
+   {
+      return lhs.m_ops == rhs.m_ops && lhs.m_ops->equal(lhs.m_storage, rhs.m_storage);
+   }
+
+private:
+   struct Ops
+   {
+      void (*execute)(void *, internal::UniqueFunction &&);
+      void (*executeHandle)(void *, stdcr::coroutine_handle<>);
+      void (*executeBatch)(void *, std::span<stdcr::coroutine_handle<>>);
+      void (*copy)(const void * from, void * to) noexcept;
+      void (*destroy)(void *) noexcept;
+      bool (*equal)(const void *, const void *) noexcept;
+      bool (*expired)(const void *) noexcept;
+      bool (*shouldYield)(const void *) noexcept;
+      bool (*runningInThisThread)(const void *) noexcept;
+   };
+
+   template <typename E>
+   static E & Get(void * storage) noexcept
+   {
+      return *std::launder(reinterpret_cast<E *>(storage));
+   }
+   template <typename E>
+   static const E & Get(const void * storage) noexcept
+   {
+      return *std::launder(reinterpret_cast<const E *>(storage));
+   }
+
+   template <typename E>
+   static constexpr Ops s_ops{
+      [](void * storage, internal::UniqueFunction && f) {
+         Get<E>(storage).Execute(std::move(f));
+      },
+      [](void * storage, stdcr::coroutine_handle<> h) {
+         Get<E>(storage).Execute(h);
+      },
+      [](void * storage, std::span<stdcr::coroutine_handle<>> handles) {
+         cr::ExecuteBatch(Get<E>(storage), handles);
+      },
+      [](const void * from, void * to) noexcept {
+         ::new (to) E(Get<E>(from));
+      },
+      [](void * storage) noexcept {
+         std::destroy_at(&Get<E>(storage));
+      },
+      [](const void * lhs, const void * rhs) noexcept {
+         if constexpr (std::equality_comparable<E>)
+            return Get<E>(lhs) == Get<E>(rhs);
+         else
+            return std::is_empty_v<E>;
+      },
+      [] {
+         if constexpr (requires(const E & e) {
+                          { e.Expired() } -> std::convertible_to<bool>;
+                       })
+            return +[](const void * storage) noexcept -> bool {
+               return Get<E>(storage).Expired();
+            };
+         else
+            return static_cast<bool (*)(const void *) noexcept>(nullptr);
+      }(),
+      [] {
+         if constexpr (internal::TimeSlicedExecutor<E>)
+            return +[](const void * storage) noexcept -> bool {
+               return Get<E>(storage).ShouldYield();
+            };
+         else
+            return static_cast<bool (*)(const void *) noexcept>(nullptr);
+      }(),
+      [] {
+         if constexpr (internal::DispatchingExecutor<E>)
+            return +[](const void * storage) noexcept -> bool {
+               return Get<E>(storage).RunningInThisThread();
+            };
+         else
+            return static_cast<bool (*)(const void *) noexcept>(nullptr);
+      }(),
+   };
+
+   alignas(void *) unsigned char m_storage[InlineSize];
+   const Ops * m_ops;
+};
+
+} // namespace cr
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef ASYNCCACHE_HPP
+#define ASYNCCACHE_HPP
+
+#include "crhandle/sharedtask.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace cr {
+
+// Key-value cache whose values are produced by coroutine loaders. Concurrent lookups of a missing
+// key share one in-flight load (see SharedTask), values that are already loaded are returned
+// without suspending. Entries are evicted in least-recently-used order once there are more than
+// `capacity` of them and are reloaded once `ttl` has passed since their load was started. Failed
+// loads are not cached. Lookups may come from any thread.
+template <typename K,
+          typename V,
+          Executor E = InlineExecutor,
+          typename Clock = std::chrono::steady_clock,
+          typename Hash = std::hash<K>>
+class AsyncCache
+{
+   using Shared = SharedTask<V, E>;
+
+public:
+   struct Limits
+   {
+      std::size_t capacity = std::numeric_limits<std::size_t>::max();
+      typename Clock::duration ttl = Clock::duration::max();
+   };
+
+   // Loaders are started on executor
+   explicit AsyncCache(Limits limits = {}, E executor = {})
+      : m_limits(limits)
+      , m_executor(std::move(executor))
+   {
+      assert(m_limits.capacity > 0);
+   }
+
+   AsyncCache(const AsyncCache &) = delete;
+   AsyncCache & operator=(const AsyncCache &) = delete;
+
+   // Awaits a copy of the value for key, rethrows the exception thrown by the loader. On a miss,
+   // loader(key) or loader() is called under the cache lock and must return a TaskHandle<V, E>.
+   template <typename F>
+   [[nodiscard]] auto Get(const K & key, F && loader)
+   {
+      struct Awaiter : decltype(std::declval<const Shared &>().Get())
+      {
+         V await_resume() const { return this->state->Result(); }
+      };
+      return Awaiter{Lookup(key, std::forward<F>(loader)).Get()};
+   }
+
+   void Invalidate(const K & key)
+   {
+      std::lock_guard lock(m_mutex);
+      if (auto it = m_entries.find(key); it != m_entries.end())
+         Erase(it);
+   }
+
+   void Clear()
+   {
+      std::lock_guard lock(m_mutex);
+      m_entries.clear();
+      m_order.clear();
+   }
+
+   std::size_t Size() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_entries.size();
+   }
+
+private:
+   using TimePoint = typename Clock::time_point;
+
+   struct Entry
+   {
+      Shared task;
+      TimePoint expires;
+      typename std::list<K>::iterator position;
+   };
+   using EntryMap = std::unordered_map<K, Entry, Hash>;
+
+   template <typename F>
+   Shared Lookup(const K & key, F && loader)
+   {
+      const bool expiring = m_limits.ttl != Clock::duration::max();
+      const TimePoint now = expiring ? Clock::now() : TimePoint{};
+
+      std::lock_guard lock(m_mutex);
+      auto it = m_entries.find(key);
+      if (it != m_entries.end()) {
+         Entry & entry = it->second;
+         if (!entry.task.Failed() && (!expiring || now < entry.expires)) {
+            m_order.splice(m_order.begin(), m_order, entry.position);
+            return entry.task;
+         }
+         Erase(it);
+      }
+
+      Shared task(Load(key, loader), m_executor);
+      if (m_entries.size() == m_limits.capacity)
+         Erase(m_entries.find(m_order.back()));
+      const TimePoint expires = expiring ? now + m_limits.ttl : TimePoint::max();
+      m_order.push_front(key);
+      m_entries.emplace(key, Entry{task, expires, m_order.begin()});
+      return task;
+   }
+
+   template <typename F>
+   static TaskHandle<V, E> Load(const K & key, F & loader)
+   {
+      if constexpr (std::invocable<F &, const K &>)
+         return std::invoke(loader, key);
+      else
+         return std::invoke(loader);
+   }
+
+   // Awaiters and the load itself keep the shared task alive after eviction
+   void Erase(typename EntryMap::iterator it)
+   {
+      m_order.erase(it->second.position);
+      m_entries.erase(it);
+   }
+
+   const Limits m_limits;
+   const E m_executor;
+   mutable std::mutex m_mutex;
+   EntryMap m_entries;
+   std::list<K> m_order; // most recently used first
+};
+
+} // namespace cr
+
+#endif
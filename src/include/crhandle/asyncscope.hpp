@@ -0,0 +1,98 @@
+#ifndef ASYNCSCOPE_HPP
+#define ASYNCSCOPE_HPP
+
+#include "crhandle/spawn.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+namespace cr {
+
+// Owns tasks started from any thread and lets its owner wait for all of them to finish. Children
+// are not registered individually: they share the scope's stop flag as their parent cancelation
+// flag, so starting a child is a frame from the frame cache plus an atomic increment, and
+// RequestStop() is O(1) no matter how many children are alive. As with a dropped TaskHandle, a
+// stopped child unwinds with CanceledException the next time it is resumed.
+class AsyncScope
+{
+public:
+   AsyncScope() = default;
+   AsyncScope(const AsyncScope &) = delete;
+   AsyncScope & operator=(const AsyncScope &) = delete;
+
+   ~AsyncScope() { assert(Live() == 0); }
+
+   // Posts a child that co_awaits fn(), which returns a TaskHandle<T, E>. Children started after
+   // RequestStop() are canceled before they run.
+   template <Executor E, typename F>
+   void Spawn(E executor, F && fn)
+   {
+      auto task = internal::SpawnRoot(*this, executor, std::decay_t<F>(std::forward<F>(fn)));
+      m_children.Acquire();
+      executor.Execute(task.handle);
+   }
+
+   void RequestStop() noexcept { std::atomic_ref(m_stop).store(true, std::memory_order_relaxed); }
+
+   bool StopRequested() const noexcept
+   {
+      return std::atomic_ref(const_cast<bool &>(m_stop)).load(std::memory_order_relaxed);
+   }
+
+   std::size_t Live() const noexcept { return m_children.Count(); }
+
+   // Resumes the awaiting coroutine once all children have finished, on the thread that finished
+   // the last one. Rethrows the first exception other than CanceledException thrown by a child.
+   [[nodiscard]] auto Join()
+   {
+      struct Awaiter : decltype(std::declval<internal::TaskCounter &>().WhenZero())
+      {
+         AsyncScope & scope;
+
+         void await_resume()
+         {
+            std::lock_guard lock(scope.m_errorMutex);
+            if (auto error = std::exchange(scope.m_error, nullptr))
+               std::rethrow_exception(error);
+         }
+      };
+      return Awaiter{m_children.WhenZero(), *this};
+   }
+
+private:
+   template <Executor, typename>
+   friend struct internal::SpawnPromise;
+   template <typename>
+   friend struct internal::SpawnFinalizer;
+
+   const bool * StopFlag() const noexcept { return &m_stop; }
+   void Release() noexcept { m_children.Release(); }
+
+   void HandleException(std::exception_ptr exception) noexcept
+   {
+      try {
+         std::rethrow_exception(exception);
+      }
+      catch (const CanceledException &) {
+         return;
+      }
+      catch (...) {
+      }
+      std::lock_guard lock(m_errorMutex);
+      if (!m_error)
+         m_error = std::move(exception);
+   }
+
+   bool m_stop = false;
+   internal::TaskCounter m_children;
+   std::mutex m_errorMutex;
+   std::exception_ptr m_error;
+};
+
+} // namespace cr
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef BROADCASTCHANNEL_HPP
+#define BROADCASTCHANNEL_HPP
+
+#include "crhandle/taskhandle.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace cr {
+
+// What happens to a subscriber that hasn't read the oldest item when it is about to be overwritten
+enum class SlowSubscriberPolicy
+{
+   Lag,  // the subscriber skips the overwritten items, Subscriber::Missed() counts them
+   Drop, // the subscriber is disconnected and its pending and further receives are canceled
+};
+
+// Delivers every item to every subscriber. Items are stored once in a fixed-size ring buffer shared
+// by all subscribers, each of which has its own read cursor and is resumed through its own
+// executor. All state is modified on the channel's executor, thus producers and subscribers may
+// live on other threads as long as the executors used are thread safe.
+template <typename T, Executor E = InlineExecutor>
+class BroadcastChannel
+   : public std::enable_shared_from_this<BroadcastChannel<T, E>>
+   , private E
+{
+   struct SubscriberState;
+
+public:
+   using ChT = BroadcastChannel<T, E>;
+   using ItemPtr = std::shared_ptr<const T>;
+
+   static std::shared_ptr<ChT> Make(std::size_t capacity,
+                                    SlowSubscriberPolicy policy = SlowSubscriberPolicy::Lag,
+                                    E executor = {})
+   {
+      return std::shared_ptr<ChT>(new BroadcastChannel(capacity, policy, std::move(executor)));
+   }
+
+   ~BroadcastChannel()
+   {
+      for (auto & subscriber : m_subscribers)
+         if (subscriber->waiting)
+            Resume(*subscriber);
+   }
+
+   class Producer : private E
+   {
+   public:
+      explicit Producer(const std::shared_ptr<ChT> & channel)
+         : E(static_cast<E &>(*channel))
+         , m_channel(channel)
+      {}
+
+      bool Send(T && item)
+      {
+         auto channel = m_channel.lock();
+         if (!channel)
+            return false;
+
+         E::Execute([channel = std::move(channel),
+                     item = std::make_shared<const T>(std::move(item))]() mutable {
+            channel->SubmitItem(std::move(item));
+         });
+         return true;
+      }
+
+   private:
+      std::weak_ptr<ChT> m_channel;
+   };
+
+   class Subscriber
+   {
+   public:
+      // Receives the items sent after the subscription has been processed on the channel's executor
+      explicit Subscriber(const std::shared_ptr<ChT> & channel, E executor = {})
+         : m_channel(channel)
+         , m_state(std::make_shared<SubscriberState>(std::move(executor)))
+      {
+         channel->Execute([channel, state = m_state] {
+            channel->SubmitSubscriber(state);
+         });
+      }
+
+      Subscriber(const Subscriber &) = delete;
+      Subscriber & operator=(const Subscriber &) = delete;
+
+      ~Subscriber()
+      {
+         if (auto channel = m_channel.lock()) {
+            channel->Execute([channel, state = std::move(m_state)] {
+               channel->RemoveSubscriber(*state);
+            });
+         }
+      }
+
+      // Throws CanceledException if the channel dies or the subscriber is dropped for being slow
+      [[nodiscard]] auto Receive()
+      {
+         struct Awaiter
+         {
+            Subscriber & subscriber;
+            ItemPtr item = nullptr;
+            std::uint64_t missed = 0;
+            stdcr::coroutine_handle<> handle = nullptr;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(stdcr::coroutine_handle<> h)
+            {
+               handle = h;
+               auto channel = subscriber.m_channel.lock();
+               if (!channel) {
+                  subscriber.m_state->Execute(h);
+                  return;
+               }
+               channel->Execute([channel, this] {
+                  channel->SubmitReceiver(*subscriber.m_state, *this);
+               });
+            }
+            ItemPtr await_resume()
+            {
+               subscriber.m_missed += missed;
+               if (!item)
+                  throw CanceledException{};
+               return std::move(item);
+            }
+         };
+         return Awaiter{*this};
+      }
+
+      // Number of items that have been overwritten before this subscriber could receive them
+      std::uint64_t Missed() const noexcept { return m_missed; }
+
+   private:
+      friend class BroadcastChannel;
+
+      std::weak_ptr<ChT> m_channel;
+      std::shared_ptr<SubscriberState> m_state;
+      std::uint64_t m_missed = 0;
+   };
+
+private:
+   struct ReceiverSlot
+   {
+      ItemPtr * item;
+      std::uint64_t * missed;
+      stdcr::coroutine_handle<> handle;
+   };
+
+   struct SubscriberState : E
+   {
+      explicit SubscriberState(E executor)
+         : E(std::move(executor))
+      {}
+
+      std::uint64_t cursor = 0;
+      std::uint64_t lagged = 0;
+      bool dropped = false;
+      std::optional<ReceiverSlot> waiting;
+   };
+
+   BroadcastChannel(std::size_t capacity, SlowSubscriberPolicy policy, E executor)
+      : E{executor}
+      , m_ring(capacity)
+      , m_policy(policy)
+   {
+      assert(capacity > 0);
+   }
+
+   void SubmitSubscriber(const std::shared_ptr<SubscriberState> & state)
+   {
+      state->cursor = m_tail;
+      m_subscribers.emplace_back(state);
+   }
+
+   void RemoveSubscriber(const SubscriberState & state)
+   {
+      std::erase_if(m_subscribers, [&](const auto & s) {
+         return s.get() == &state;
+      });
+   }
+
+   template <typename A>
+   void SubmitReceiver(SubscriberState & state, A & awaiter)
+   {
+      assert(!state.waiting);
+      state.waiting.emplace(ReceiverSlot{&awaiter.item, &awaiter.missed, awaiter.handle});
+      if (state.dropped || state.cursor < m_tail)
+         Resume(state);
+   }
+
+   void SubmitItem(ItemPtr && item)
+   {
+      const std::size_t capacity = m_ring.size();
+      if (m_tail >= capacity) {
+         const std::uint64_t oldest = m_tail - capacity;
+         for (auto & subscriber : m_subscribers) {
+            if (subscriber->cursor > oldest)
+               continue;
+            if (m_policy == SlowSubscriberPolicy::Lag) {
+               subscriber->lagged += oldest + 1 - subscriber->cursor;
+               subscriber->cursor = oldest + 1;
+            } else {
+               subscriber->dropped = true;
+            }
+         }
+         if (m_policy == SlowSubscriberPolicy::Drop) {
+            std::erase_if(m_subscribers, [](const auto & s) {
+               return s->dropped;
+            });
+         }
+      }
+
+      m_ring[m_tail % capacity] = std::move(item);
+      ++m_tail;
+
+      // resumed subscribers might (un)subscribe or send more items, so hand the item over to a
+      // snapshot of them before resuming any
+      auto wakeups = std::move(m_wakeups);
+      auto handles = std::move(m_handles);
+      for (auto & subscriber : m_subscribers) {
+         if (subscriber->waiting && subscriber->cursor < m_tail) {
+            wakeups.emplace_back(subscriber);
+            handles.push_back(HandOver(*subscriber));
+         }
+      }
+      // consecutive subscribers sharing an executor are woken up with a single batch
+      for (std::size_t first = 0; first < wakeups.size();) {
+         E & executor = *wakeups[first];
+         std::size_t last = first + 1;
+         if constexpr (internal::BatchExecutor<E> && std::equality_comparable<E>) {
+            while (last < wakeups.size() && static_cast<E &>(*wakeups[last]) == executor)
+               ++last;
+         }
+         cr::ExecuteBatch(executor, std::span(handles).subspan(first, last - first));
+         first = last;
+      }
+      wakeups.clear();
+      handles.clear();
+      m_wakeups = std::move(wakeups);
+      m_handles = std::move(handles);
+   }
+
+   // Hands over the next item if any, and returns the waiting receiver to resume
+   stdcr::coroutine_handle<> HandOver(SubscriberState & state)
+   {
+      ReceiverSlot slot = *state.waiting;
+      state.waiting.reset();
+      if (!state.dropped && state.cursor < m_tail) {
+         *slot.item = m_ring[state.cursor % m_ring.size()];
+         *slot.missed = std::exchange(state.lagged, 0);
+         ++state.cursor;
+      }
+      return slot.handle;
+   }
+
+   // Resumes the waiting receiver on the subscriber's executor
+   void Resume(SubscriberState & state) { state.Execute(HandOver(state)); }
+
+   std::vector<ItemPtr> m_ring;
+   std::uint64_t m_tail = 0;
+   const SlowSubscriberPolicy m_policy;
+   std::vector<std::shared_ptr<SubscriberState>> m_subscribers;
+   std::vector<std::shared_ptr<SubscriberState>> m_wakeups;
+   std::vector<stdcr::coroutine_handle<>> m_handles;
+};
+
+} // namespace cr
+
+#endif
@@ -9,6 +9,7 @@
 
 namespace stdcr {
 using std::experimental::coroutine_handle;
+using std::experimental::noop_coroutine;
 using std::experimental::suspend_always;
 using std::experimental::suspend_never;
 } // namespace stdcr
@@ -19,6 +20,7 @@ using std::experimental::suspend_never;
 
 namespace stdcr {
 using std::coroutine_handle;
+using std::noop_coroutine;
 using std::suspend_always;
 using std::suspend_never;
 } // namespace stdcr
@@ -0,0 +1,249 @@
+#ifndef DEADLINEDISPATCHER_HPP
+#define DEADLINEDISPATCHER_HPP
+
+#include "crhandle/coroutine.hpp"
+#include "crhandle/timeslice.hpp"
+#include "crhandle/uniquefunction.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace cr {
+
+// Earliest-deadline-first run queue drained by its owner, tasks may be posted from any thread.
+// The deadline is a part of the executor, which Promise::await_transform copies to nested tasks, so
+// children inherit the deadline of the task that awaits them. Tasks with equal deadlines run in
+// FIFO order, tasks without a deadline run after all others.
+// When dropping is enabled, a task resumed after its deadline has passed is canceled at its next
+// co_await (see Executor::Expired()), i.e. it unwinds with CanceledException instead of running on.
+// With a non-zero time slice, a task that has been running for longer than that is reposted at its
+// next co_await even if the awaited operation is already complete (see Executor::ShouldYield()).
+template <typename Clock = std::chrono::steady_clock>
+class DeadlineDispatcher
+{
+public:
+   using TimePoint = typename Clock::time_point;
+
+   struct Executor
+   {
+      DeadlineDispatcher * dispatcher = nullptr;
+      TimePoint deadline = TimePoint::max();
+
+      template <typename F>
+      void Execute(F && task) const
+      {
+         assert(dispatcher);
+         dispatcher->Post(deadline, std::forward<F>(task));
+      }
+
+      void ExecuteBatch(std::span<stdcr::coroutine_handle<>> handles) const
+      {
+         assert(dispatcher);
+         dispatcher->PostBatch(deadline, handles);
+      }
+
+      // Queried by Promise when resuming a task on this executor
+      bool Expired() const noexcept { return dispatcher && dispatcher->IsLate(deadline); }
+
+      // Queried by Promise before continuing synchronously past a co_await
+      bool ShouldYield() const noexcept { return dispatcher && dispatcher->m_slice.Exceeded(); }
+
+      // True on the thread draining the dispatcher while it runs a task with the same deadline
+      bool RunningInThisThread() const noexcept
+      {
+         return dispatcher && dispatcher->IsRunning(deadline);
+      }
+
+      Executor WithDeadline(TimePoint tp) const noexcept { return Executor{dispatcher, tp}; }
+
+      bool operator==(const Executor &) const = default;
+   };
+
+   explicit DeadlineDispatcher(bool dropLateTasks = false,
+                               std::chrono::microseconds timeSlice = {})
+      : m_dropLate(dropLateTasks)
+      , m_slice(timeSlice)
+   {}
+
+   DeadlineDispatcher(const DeadlineDispatcher &) = delete;
+   DeadlineDispatcher & operator=(const DeadlineDispatcher &) = delete;
+
+   Executor GetExecutor(TimePoint deadline = TimePoint::max()) noexcept
+   {
+      return Executor{this, deadline};
+   }
+
+   template <typename F>
+   void Post(TimePoint deadline, F && task)
+   {
+      std::lock_guard lock(m_mutex);
+      Push(deadline, std::forward<F>(task));
+   }
+
+   // Queues all handles under a single lock, they keep their order among equal deadlines
+   void PostBatch(TimePoint deadline, std::span<stdcr::coroutine_handle<>> handles)
+   {
+      std::lock_guard lock(m_mutex);
+      for (stdcr::coroutine_handle<> h : handles)
+         Push(deadline, h);
+   }
+
+   bool ProcessOneTask()
+   {
+      internal::UniqueFunction task;
+      TimePoint deadline;
+      {
+         std::lock_guard lock(m_mutex);
+         if (m_heap.empty())
+            return false;
+         const Key top = m_heap.front();
+         m_heap.front() = m_heap.back();
+         m_heap.pop_back();
+         if (!m_heap.empty())
+            SiftDown(0);
+         task = std::move(m_slots[top.slot]);
+         m_freeSlots.push_back(top.slot);
+         deadline = top.deadline;
+      }
+      if (m_dropLate)
+         m_now = Clock::now();
+      m_slice.Start();
+      RunningScope running(this, deadline);
+      task();
+      return true;
+   }
+
+   std::size_t ProcessAll()
+   {
+      std::size_t count = 0;
+      while (ProcessOneTask())
+         ++count;
+      return count;
+   }
+
+   std::size_t Pending() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_heap.size();
+   }
+
+private:
+   static constexpr std::size_t Arity = 4;
+
+   // Kept small so that a 64-byte cache line holds all children of a node, the tasks live in
+   // m_slots. Sequence numbers are compared modulo 2^32 and only break ties between deadlines.
+   struct Key
+   {
+      TimePoint deadline;
+      std::uint32_t seq;
+      std::uint32_t slot;
+
+      bool operator<(const Key & other) const noexcept
+      {
+         if (deadline != other.deadline)
+            return deadline < other.deadline;
+         return static_cast<std::int32_t>(seq - other.seq) < 0;
+      }
+   };
+
+   // Marks the calling thread as running a task with the given deadline, restores the previous
+   // state when leaving a nested ProcessOneTask()
+   class RunningScope
+   {
+   public:
+      RunningScope(const DeadlineDispatcher * dispatcher, TimePoint deadline) noexcept
+         : m_prevDispatcher(std::exchange(t_running, dispatcher))
+         , m_prevDeadline(std::exchange(t_runningDeadline, deadline))
+      {}
+      ~RunningScope()
+      {
+         t_running = m_prevDispatcher;
+         t_runningDeadline = m_prevDeadline;
+      }
+
+   private:
+      const DeadlineDispatcher * m_prevDispatcher;
+      TimePoint m_prevDeadline;
+   };
+
+   // Uses the time sampled when the current task was dequeued, only called on the draining thread
+   bool IsLate(TimePoint deadline) const noexcept { return m_dropLate && deadline < m_now; }
+
+   bool IsRunning(TimePoint deadline) const noexcept
+   {
+      return t_running == this && t_runningDeadline == deadline;
+   }
+
+   template <typename F>
+   void Push(TimePoint deadline, F && task)
+   {
+      std::uint32_t slot;
+      if (m_freeSlots.empty()) {
+         slot = static_cast<std::uint32_t>(m_slots.size());
+         m_slots.emplace_back(std::forward<F>(task));
+      } else {
+         slot = m_freeSlots.back();
+         m_freeSlots.pop_back();
+         m_slots[slot] = internal::UniqueFunction(std::forward<F>(task));
+      }
+      m_heap.push_back(Key{deadline, m_nextSeq++, slot});
+      SiftUp(m_heap.size() - 1);
+   }
+
+   void SiftUp(std::size_t i) noexcept
+   {
+      const Key key = m_heap[i];
+      while (i > 0) {
+         const std::size_t parent = (i - 1) / Arity;
+         if (!(key < m_heap[parent]))
+            break;
+         m_heap[i] = m_heap[parent];
+         i = parent;
+      }
+      m_heap[i] = key;
+   }
+
+   void SiftDown(std::size_t i) noexcept
+   {
+      const Key key = m_heap[i];
+      const std::size_t size = m_heap.size();
+      while (true) {
+         const std::size_t first = i * Arity + 1;
+         if (first >= size)
+            break;
+         const std::size_t last = std::min(first + Arity, size);
+         std::size_t best = first;
+         for (std::size_t c = first + 1; c < last; ++c)
+            if (m_heap[c] < m_heap[best])
+               best = c;
+         if (!(m_heap[best] < key))
+            break;
+         m_heap[i] = m_heap[best];
+         i = best;
+      }
+      m_heap[i] = key;
+   }
+
+   const bool m_dropLate;
+   internal::TimeSlice m_slice;
+   TimePoint m_now = TimePoint::min();
+   mutable std::mutex m_mutex;
+   std::vector<Key> m_heap;
+   std::vector<internal::UniqueFunction> m_slots;
+   std::vector<std::uint32_t> m_freeSlots;
+   std::uint32_t m_nextSeq = 0;
+
+   static inline thread_local const DeadlineDispatcher * t_running = nullptr;
+   static inline thread_local TimePoint t_runningDeadline{};
+};
+
+} // namespace cr
+
+#endif
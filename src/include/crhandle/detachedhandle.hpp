@@ -29,6 +29,8 @@ struct DetachedPromise
    {
       return handle.Run();
    }
+   // there is no executor to yield to
+   stdcr::suspend_never await_transform(YieldAwaitable) const noexcept { return {}; }
 };
 
 } // namespace cr
@@ -0,0 +1,184 @@
+#ifndef FRAMECACHE_HPP
+#define FRAMECACHE_HPP
+
+#include <array>
+#include <cstddef>
+#include <new>
+
+namespace cr {
+
+#ifdef CRHANDLE_FRAME_STATS
+// Debug accounting of the frames allocated for TaskHandle coroutines. Counters are per-thread, so
+// liveFrames and liveBytes are only meaningful when frames are freed on the thread that made them.
+struct FrameStats
+{
+   std::size_t allocatedFrames = 0;
+   std::ptrdiff_t liveFrames = 0;
+   std::ptrdiff_t liveBytes = 0;
+   std::size_t lastFrameSize = 0;
+};
+
+inline FrameStats & ThreadFrameStats() noexcept
+{
+   thread_local FrameStats stats;
+   return stats;
+}
+#endif
+
+namespace internal {
+
+// Per-thread free lists of coroutine frames bucketed by size, so that creating and finishing tasks
+// in a steady state does not go to the global allocator. A frame may be freed on a different thread
+// than the one that allocated it, in which case it simply migrates to the other thread's cache.
+//
+// Spawned root frames always use it. TaskHandle frames do only when CRHANDLE_FRAME_CACHE is
+// defined (CMake option crhandle_frame_cache), since recycled frames hide use-after-free bugs from
+// sanitizers and compilers that elide frame allocations need plain operator new to do so.
+class FrameCache
+{
+public:
+   static constexpr std::size_t Granularity = 64;
+   static constexpr std::size_t BucketCount = 16;
+   static constexpr std::size_t MaxFramesPerBucket = 32;
+
+   FrameCache() = default;
+   FrameCache(const FrameCache &) = delete;
+   FrameCache & operator=(const FrameCache &) = delete;
+
+   ~FrameCache()
+   {
+      for (Block * head : m_buckets) {
+         while (head) {
+            Block * next = head->next;
+            ::operator delete(head);
+            head = next;
+         }
+      }
+   }
+
+   // Returns nullptr during thread shutdown after the cache has been destroyed
+   static FrameCache * ForThisThread() noexcept
+   {
+      struct Owner
+      {
+         FrameCache cache;
+         ~Owner() { s_destroyed = true; }
+      };
+      if (s_destroyed)
+         return nullptr;
+      thread_local Owner owner;
+      return &owner.cache;
+   }
+
+   static std::size_t BucketIndex(std::size_t size) noexcept { return (size - 1) / Granularity; }
+
+   // Frames that fit in a bucket are always allocated with the bucket size, no matter which thread
+   // or cache they come from, so that any frame in a bucket can be reused for any size it covers
+   static std::size_t BlockSize(std::size_t size) noexcept
+   {
+      const std::size_t bucket = BucketIndex(size);
+      return bucket < BucketCount ? (bucket + 1) * Granularity : size;
+   }
+
+   void * Allocate(std::size_t size)
+   {
+      const std::size_t bucket = BucketIndex(size);
+      if (bucket < BucketCount) {
+         if (Block * block = m_buckets[bucket]) {
+            m_buckets[bucket] = block->next;
+            --m_sizes[bucket];
+            return block;
+         }
+      }
+      return ::operator new(BlockSize(size));
+   }
+
+   void Deallocate(void * frame, std::size_t size) noexcept
+   {
+      const std::size_t bucket = BucketIndex(size);
+      if (bucket >= BucketCount || m_sizes[bucket] >= MaxFramesPerBucket) {
+         ::operator delete(frame);
+         return;
+      }
+      m_buckets[bucket] = ::new (frame) Block{m_buckets[bucket]};
+      ++m_sizes[bucket];
+   }
+
+private:
+   struct Block
+   {
+      Block * next;
+   };
+
+   static inline thread_local bool s_destroyed = false;
+
+   std::array<Block *, BucketCount> m_buckets{};
+   std::array<std::size_t, BucketCount> m_sizes{};
+};
+
+inline void RecordFrameAllocation([[maybe_unused]] std::size_t size) noexcept
+{
+#ifdef CRHANDLE_FRAME_STATS
+   FrameStats & stats = ThreadFrameStats();
+   ++stats.allocatedFrames;
+   ++stats.liveFrames;
+   stats.liveBytes += static_cast<std::ptrdiff_t>(size);
+   stats.lastFrameSize = size;
+#endif
+}
+
+inline void RecordFrameDeallocation([[maybe_unused]] std::size_t size) noexcept
+{
+#ifdef CRHANDLE_FRAME_STATS
+   FrameStats & stats = ThreadFrameStats();
+   --stats.liveFrames;
+   stats.liveBytes -= static_cast<std::ptrdiff_t>(size);
+#endif
+}
+
+// Allocation for promises that always recycle their frames, e.g. the roots started by cr::Spawn()
+inline void * AllocatePooledFrame(std::size_t size)
+{
+   FrameCache * cache = FrameCache::ForThisThread();
+   void * frame = cache ? cache->Allocate(size) : ::operator new(FrameCache::BlockSize(size));
+   RecordFrameAllocation(size);
+   return frame;
+}
+
+inline void DeallocatePooledFrame(void * frame, std::size_t size) noexcept
+{
+   RecordFrameDeallocation(size);
+   if (FrameCache * cache = FrameCache::ForThisThread())
+      cache->Deallocate(frame, size);
+   else
+      ::operator delete(frame);
+}
+
+#if defined(CRHANDLE_FRAME_STATS) || defined(CRHANDLE_FRAME_CACHE)
+// Allocation for TaskHandle frames, which only go through the cache if it has been enabled
+inline void * AllocateFrame(std::size_t size)
+{
+#ifdef CRHANDLE_FRAME_CACHE
+   return AllocatePooledFrame(size);
+#else
+   void * frame = ::operator new(size);
+   RecordFrameAllocation(size);
+   return frame;
+#endif
+}
+
+inline void DeallocateFrame(void * frame, std::size_t size) noexcept
+{
+#ifdef CRHANDLE_FRAME_CACHE
+   DeallocatePooledFrame(frame, size);
+#else
+   RecordFrameDeallocation(size);
+   ::operator delete(frame);
+#endif
+}
+#endif
+
+} // namespace internal
+} // namespace cr
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef ONESHOT_HPP
+#define ONESHOT_HPP
+
+#include "crhandle/taskhandle.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace cr {
+
+// Hands over a single value, e.g. the response to a request, from a Sender to a Receiver that may
+// live on different threads. Both ends share one allocation that holds the value, the waiting
+// coroutine and a word of atomic state; whichever end finishes last frees it. The receiving
+// coroutine is resumed through the executor the pair was made with.
+template <typename T, Executor E = InlineExecutor>
+class Oneshot
+{
+   struct State;
+
+public:
+   class Sender
+   {
+   public:
+      Sender(Sender && other) noexcept
+         : m_state(std::exchange(other.m_state, nullptr))
+      {}
+      Sender & operator=(Sender && other) noexcept
+      {
+         Sender(std::move(other)).Swap(*this);
+         return *this;
+      }
+      Sender(const Sender &) = delete;
+      Sender & operator=(const Sender &) = delete;
+
+      // A receiver that is still waiting throws CanceledException
+      ~Sender()
+      {
+         if (m_state)
+            Complete();
+      }
+
+      // Returns false if the value has already been set or the receiver is gone
+      bool Set(T value)
+      {
+         if (!m_state)
+            return false;
+         m_state->value.emplace(std::move(value));
+         return Complete();
+      }
+
+      // Lets the sender skip producing a value nobody waits for
+      bool ReceiverGone() const noexcept
+      {
+         return !m_state || (m_state->flags.load(std::memory_order_acquire) & ReceiverDone);
+      }
+
+   private:
+      friend class Oneshot;
+
+      explicit Sender(State * state) noexcept
+         : m_state(state)
+      {}
+
+      void Swap(Sender & other) noexcept { std::swap(m_state, other.m_state); }
+
+      // Publishes the value, if any, and resumes or frees according to what the receiver did
+      bool Complete()
+      {
+         State * state = std::exchange(m_state, nullptr);
+         // once SenderDone is out, the resumed receiver may free the state at any point, even
+         // while Execute() is still running, so the post goes through copies
+         E executor = static_cast<const E &>(*state);
+         const std::uint8_t prev = state->flags.fetch_or(SenderDone, std::memory_order_acq_rel);
+         if (prev & ReceiverDone) {
+            delete state;
+            return false;
+         }
+         if (prev & Waiting) {
+            // the waiter stays suspended, and the state alive, until it is resumed from here
+            stdcr::coroutine_handle<> waiter = state->waiter;
+            executor.Execute(waiter);
+         }
+         return true;
+      }
+
+      State * m_state;
+   };
+
+   class Receiver
+   {
+   public:
+      Receiver(Receiver && other) noexcept
+         : m_state(std::exchange(other.m_state, nullptr))
+      {}
+      Receiver & operator=(Receiver && other) noexcept
+      {
+         Receiver(std::move(other)).Swap(*this);
+         return *this;
+      }
+      Receiver(const Receiver &) = delete;
+      Receiver & operator=(const Receiver &) = delete;
+
+      // Must not be destroyed while a Receive() is suspended
+      ~Receiver()
+      {
+         if (!m_state)
+            return;
+         const std::uint8_t prev = m_state->flags.fetch_or(ReceiverDone, std::memory_order_acq_rel);
+         if (prev & SenderDone)
+            delete m_state;
+      }
+
+      // Awaited once. Throws CanceledException if the sender is destroyed without setting a value;
+      // a task canceled while waiting unwinds as soon as the sender completes.
+      [[nodiscard]] auto Receive()
+      {
+         struct Awaiter
+         {
+            State & state;
+
+            bool await_ready() const noexcept
+            {
+               return state.flags.load(std::memory_order_acquire) & SenderDone;
+            }
+            bool await_suspend(stdcr::coroutine_handle<> h) noexcept
+            {
+               state.waiter = h;
+               const std::uint8_t prev = state.flags.fetch_or(Waiting, std::memory_order_acq_rel);
+               return !(prev & SenderDone);
+            }
+            T await_resume()
+            {
+               if (!state.value)
+                  throw CanceledException{};
+               return std::move(*state.value);
+            }
+         };
+         assert(m_state);
+         return Awaiter{*m_state};
+      }
+
+   private:
+      friend class Oneshot;
+
+      explicit Receiver(State * state) noexcept
+         : m_state(state)
+      {}
+
+      void Swap(Receiver & other) noexcept { std::swap(m_state, other.m_state); }
+
+      State * m_state;
+   };
+
+   static std::pair<Sender, Receiver> Make(E executor = {})
+   {
+      auto * state = new State(std::move(executor));
+      return {Sender(state), Receiver(state)};
+   }
+
+private:
+   enum : std::uint8_t
+   {
+      SenderDone = 1,   // value set or sender destroyed, the value is published with this bit
+      ReceiverDone = 2, // receiver destroyed
+      Waiting = 4,      // the waiter has been stored
+   };
+
+   struct State : E
+   {
+      explicit State(E && executor)
+         : E(std::move(executor))
+      {}
+
+      std::atomic<std::uint8_t> flags = 0;
+      stdcr::coroutine_handle<> waiter = nullptr;
+      std::optional<T> value;
+   };
+};
+
+} // namespace cr
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef PARALLELFOR_HPP
+#define PARALLELFOR_HPP
+
+#include "crhandle/framecache.hpp"
+#include "crhandle/taskhandle.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <ranges>
+#include <utility>
+#include <vector>
+
+namespace cr {
+
+namespace internal {
+
+// Self-destroying frame that runs one ParallelFor() chunk, so that the chunks can be posted with a
+// single ExecuteBatch() call
+struct ParallelForChunk
+{
+   struct promise_type
+   {
+      static void * operator new(std::size_t size) { return AllocatePooledFrame(size); }
+      static void operator delete(void * frame, std::size_t size) noexcept
+      {
+         DeallocatePooledFrame(frame, size);
+      }
+
+      ParallelForChunk get_return_object() noexcept
+      {
+         return {stdcr::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+      stdcr::suspend_always initial_suspend() const noexcept { return {}; }
+      stdcr::suspend_never final_suspend() const noexcept { return {}; }
+      void return_void() const noexcept {}
+      void unhandled_exception() const noexcept { std::terminate(); }
+   };
+
+   stdcr::coroutine_handle<promise_type> handle;
+};
+
+template <Executor E, std::ranges::random_access_range R, typename F>
+class ParallelForAwaiter
+{
+public:
+   ParallelForAwaiter(E executor, R & range, std::size_t grain, F fn)
+      : m_executor(std::move(executor))
+      , m_begin(std::ranges::begin(range))
+      , m_size(static_cast<std::size_t>(std::ranges::size(range)))
+      , m_grain(std::max<std::size_t>(grain, 1))
+      , m_fn(std::move(fn))
+   {}
+
+   ParallelForAwaiter(ParallelForAwaiter && other) noexcept
+      : m_executor(std::move(other.m_executor))
+      , m_begin(std::move(other.m_begin))
+      , m_size(other.m_size)
+      , m_grain(other.m_grain)
+      , m_fn(std::move(other.m_fn))
+   {
+      assert(other.m_pending.load() == 0);
+   }
+
+   // An inline executor would run the chunks one after the other anyway
+   bool await_ready()
+   {
+      if (m_size == 0)
+         return true;
+      if constexpr (IsInlineExecutor<E>) {
+         RunChunk(0, m_size);
+         return true;
+      }
+      return false;
+   }
+
+   void await_suspend(stdcr::coroutine_handle<> h)
+   {
+      m_parent = h;
+      const std::size_t chunks = (m_size + m_grain - 1) / m_grain;
+      m_pending.store(chunks, std::memory_order_relaxed);
+      // The last chunk may finish and resume the parent, which destroys this awaiter, before the
+      // posting is done, so from here on only locals are touched.
+      E executor = m_executor;
+      if constexpr (BatchExecutor<E>) {
+         std::vector<stdcr::coroutine_handle<>> handles;
+         handles.reserve(chunks);
+         for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+            handles.push_back(ChunkFrame(chunk).handle);
+         executor.ExecuteBatch(handles);
+      } else {
+         // Each closure is two pointers, small enough not to allocate in the executor's queue
+         for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+            executor.Execute([this, chunk] { FinishChunk(chunk); });
+      }
+   }
+
+   void await_resume()
+   {
+      if (m_error)
+         std::rethrow_exception(m_error);
+   }
+
+private:
+   ParallelForChunk ChunkFrame(std::size_t chunk)
+   {
+      FinishChunk(chunk);
+      co_return;
+   }
+
+   void FinishChunk(std::size_t chunk)
+   {
+      const std::size_t first = chunk * m_grain;
+      RunChunk(first, std::min(first + m_grain, m_size));
+      if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+         m_parent.resume();
+   }
+
+   void RunChunk(std::size_t first, std::size_t last)
+   {
+      if (m_failed.load(std::memory_order_relaxed))
+         return;
+      try {
+         for (auto it = m_begin + first; first != last; ++first, ++it)
+            std::invoke(m_fn, *it);
+      }
+      catch (...) {
+         std::lock_guard lock(m_errorMutex);
+         if (!m_error)
+            m_error = std::current_exception();
+         m_failed.store(true, std::memory_order_relaxed);
+      }
+   }
+
+   E m_executor;
+   std::ranges::iterator_t<R> m_begin;
+   std::size_t m_size;
+   std::size_t m_grain;
+   F m_fn;
+   stdcr::coroutine_handle<> m_parent = nullptr;
+   std::atomic<std::size_t> m_pending = 0;
+   std::atomic<bool> m_failed = false;
+   std::mutex m_errorMutex;
+   std::exception_ptr m_error;
+};
+
+} // namespace internal
+
+// Calls fn for each element of range on executor, in chunks of grain consecutive elements, and
+// resumes the awaiting coroutine once, on the thread that finishes the last chunk. Executors with
+// ExecuteBatch() get all chunks in one call, as pooled coroutine frames. Others get one post per
+// chunk and no allocations beyond what they need to queue a small closure. If fn throws, the
+// remaining chunks are skipped and the first exception is rethrown. The range must outlive the
+// co_await.
+template <Executor E, std::ranges::random_access_range R, typename F>
+   requires std::ranges::sized_range<R>
+[[nodiscard]] auto ParallelFor(E executor, R && range, std::size_t grain, F fn)
+{
+   using Awaiter = internal::ParallelForAwaiter<E, std::remove_reference_t<R>, F>;
+   return Awaiter(std::move(executor), range, grain, std::move(fn));
+}
+
+} // namespace cr
+
+#endif
@@ -0,0 +1,480 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "crhandle/asyncscope.hpp"
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/uniquefunction.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cr {
+
+namespace internal {
+
+// Queue of at most `capacity` items between two pipeline stages, used from any thread. Producers
+// that find it full and consumers that find it empty park a node in their awaiter; the other side
+// moves items straight into or out of the parked awaiter under the lock and resumes it once its
+// request has been fulfilled, so a woken coroutine never has to retry.
+template <typename T>
+class BoundedQueue
+{
+public:
+   explicit BoundedQueue(std::size_t capacity)
+      : m_capacity(capacity)
+   {
+      assert(capacity > 0);
+   }
+
+   // Only before the queue is used
+   void SetCapacity(std::size_t capacity)
+   {
+      assert(capacity > 0);
+      m_capacity = capacity;
+   }
+
+   // Pushes all items, suspending while the queue is full. Returns false if the queue is closed
+   // before that, in which case the items not pushed yet stay in the span.
+   [[nodiscard]] auto Push(std::span<T> items) { return PushAwaiter{{items, true, {}}, *this}; }
+
+   // Replaces out with between one and max items, suspending while the queue is empty. Returns
+   // false once the queue is closed and drained.
+   [[nodiscard]] auto Pop(std::vector<T> & out, std::size_t max)
+   {
+      assert(max > 0);
+      out.clear();
+      return PopAwaiter{{&out, max, {}}, *this};
+   }
+
+   // Fails parked and future pushes, lets consumers drain what is queued
+   void Close()
+   {
+      std::vector<UniqueFunction> wake;
+      {
+         std::lock_guard lock(m_mutex);
+         m_closed = true;
+         for (PushNode * pusher : m_pushers) {
+            pusher->accepted = false;
+            wake.push_back(std::move(pusher->resume));
+         }
+         m_pushers.clear();
+         for (PopNode * popper : m_poppers)
+            wake.push_back(std::move(popper->resume));
+         m_poppers.clear();
+      }
+      for (auto & resume : wake)
+         resume();
+   }
+
+   std::size_t Depth() const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_items.size();
+   }
+
+private:
+   struct PushNode
+   {
+      std::span<T> items;
+      bool accepted = true;
+      UniqueFunction resume;
+   };
+
+   struct PopNode
+   {
+      std::vector<T> * out;
+      std::size_t max;
+      UniqueFunction resume;
+   };
+
+   struct PushAwaiter : PushNode
+   {
+      BoundedQueue & queue;
+
+      bool await_ready() const noexcept { return this->items.empty(); }
+      template <typename P>
+      bool await_suspend(stdcr::coroutine_handle<P> h)
+      {
+         return queue.Submit(*this, h);
+      }
+      bool await_resume() const noexcept { return this->accepted; }
+   };
+
+   struct PopAwaiter : PopNode
+   {
+      BoundedQueue & queue;
+
+      bool await_ready() const noexcept { return false; }
+      template <typename P>
+      bool await_suspend(stdcr::coroutine_handle<P> h)
+      {
+         return queue.Submit(*this, h);
+      }
+      bool await_resume() const noexcept { return !this->out->empty(); }
+   };
+
+   // Returns true if the awaiting coroutine has been parked
+   template <typename P>
+   bool Submit(PushNode & node, stdcr::coroutine_handle<P> h)
+   {
+      std::vector<UniqueFunction> wake;
+      bool parked = false;
+      {
+         std::lock_guard lock(m_mutex);
+         if (m_closed) {
+            node.accepted = false;
+         } else {
+            Fill(node);
+            ServePoppers(wake);
+            if (!node.items.empty()) {
+               node.resume = MakeResumer(h);
+               m_pushers.push_back(&node);
+               parked = true;
+            }
+         }
+      }
+      for (auto & resume : wake)
+         resume();
+      return parked;
+   }
+
+   template <typename P>
+   bool Submit(PopNode & node, stdcr::coroutine_handle<P> h)
+   {
+      std::vector<UniqueFunction> wake;
+      {
+         std::lock_guard lock(m_mutex);
+         if (m_items.empty() && !m_closed) {
+            node.resume = MakeResumer(h);
+            m_poppers.push_back(&node);
+            return true;
+         }
+         Drain(node);
+         ServePushers(wake);
+      }
+      for (auto & resume : wake)
+         resume();
+      return false;
+   }
+
+   void Fill(PushNode & node)
+   {
+      const std::size_t count = std::min(node.items.size(), m_capacity - m_items.size());
+      for (T & item : node.items.first(count))
+         m_items.push_back(std::move(item));
+      node.items = node.items.subspan(count);
+   }
+
+   void Drain(PopNode & node)
+   {
+      const std::size_t count = std::min(node.max, m_items.size());
+      for (std::size_t i = 0; i < count; ++i) {
+         node.out->push_back(std::move(m_items.front()));
+         m_items.pop_front();
+      }
+   }
+
+   // Hands queued items to parked consumers after a push
+   void ServePoppers(std::vector<UniqueFunction> & wake)
+   {
+      while (!m_items.empty() && !m_poppers.empty()) {
+         PopNode * popper = m_poppers.front();
+         m_poppers.pop_front();
+         Drain(*popper);
+         wake.push_back(std::move(popper->resume));
+      }
+   }
+
+   // Moves items of parked producers into the space freed by a pop
+   void ServePushers(std::vector<UniqueFunction> & wake)
+   {
+      while (m_items.size() < m_capacity && !m_pushers.empty()) {
+         PushNode * pusher = m_pushers.front();
+         Fill(*pusher);
+         if (!pusher->items.empty())
+            break;
+         m_pushers.pop_front();
+         wake.push_back(std::move(pusher->resume));
+      }
+   }
+
+   std::size_t m_capacity;
+   mutable std::mutex m_mutex;
+   std::deque<T> m_items;
+   std::deque<PushNode *> m_pushers;
+   std::deque<PopNode *> m_poppers;
+   bool m_closed = false;
+};
+
+// Stage functions either return the next item or a TaskHandle producing it
+template <typename F, typename In>
+concept ReturnsTask = requires { typename std::invoke_result_t<F &, In &&>::promise_type; };
+
+template <typename F, typename In>
+struct StageResult
+{
+   using type = std::invoke_result_t<F &, In &&>;
+};
+template <typename F, typename In>
+   requires ReturnsTask<F, In>
+struct StageResult<F, In>
+{
+   using Promise = typename std::invoke_result_t<F &, In &&>::promise_type;
+   using type = decltype(std::declval<Promise &>().Result());
+};
+
+template <typename F, typename In>
+using StageResultT = typename StageResult<F, In>::type;
+
+// Closes the queues around a stage when its last worker exits, however it exits. Closing the
+// input fails upstream pushes, which matters if the workers died rather than ran out of input.
+template <typename In, typename Out>
+struct StageExit
+{
+   std::shared_ptr<std::atomic<std::size_t>> live;
+   std::shared_ptr<BoundedQueue<In>> in;
+   std::shared_ptr<BoundedQueue<Out>> out;
+
+   StageExit(std::shared_ptr<std::atomic<std::size_t>> live,
+             std::shared_ptr<BoundedQueue<In>> in,
+             std::shared_ptr<BoundedQueue<Out>> out) noexcept
+      : live(std::move(live))
+      , in(std::move(in))
+      , out(std::move(out))
+   {}
+   // the worker's frame gets a moved copy, only that one counts
+   StageExit(StageExit &&) noexcept = default;
+   StageExit & operator=(StageExit &&) = delete;
+
+   ~StageExit()
+   {
+      if (!live || live->fetch_sub(1, std::memory_order_acq_rel) != 1)
+         return;
+      in->Close();
+      if (out)
+         out->Close();
+   }
+};
+
+template <Executor E, typename In, typename Out, typename F>
+TaskHandle<void, E> StageWorker(StageExit<In, Out> exit, std::shared_ptr<F> fn, std::size_t batch)
+{
+   std::vector<In> items;
+   std::vector<Out> results;
+   items.reserve(batch);
+   results.reserve(batch);
+   while (co_await exit.in->Pop(items, batch)) {
+      for (In & item : items) {
+         if constexpr (ReturnsTask<F, In>)
+            results.push_back(co_await std::invoke(*fn, std::move(item)));
+         else
+            results.push_back(std::invoke(*fn, std::move(item)));
+      }
+      if (!co_await exit.out->Push(std::span(results)))
+         break;
+      results.clear();
+   }
+}
+
+template <Executor E, typename In, typename F>
+TaskHandle<void, E> SinkWorker(StageExit<In, In> exit, std::shared_ptr<F> fn, std::size_t batch)
+{
+   std::vector<In> items;
+   items.reserve(batch);
+   while (co_await exit.in->Pop(items, batch)) {
+      for (In & item : items) {
+         if constexpr (ReturnsTask<F, In>)
+            co_await std::invoke(*fn, std::move(item));
+         else
+            std::invoke(*fn, std::move(item));
+      }
+   }
+}
+
+} // namespace internal
+
+struct StageOptions
+{
+   std::size_t workers = 1;
+   std::size_t capacity = 64; // of the queue in front of the stage
+   std::size_t batch = 16;    // items a worker takes from its queue at once
+};
+
+// Running chain of stages linked by bounded queues, built with MakePipeline<In>(). Each stage has
+// its own executor and number of workers, the workers move items in batches of up to
+// StageOptions::batch and suspend while their output queue is full. Close() ends the input; every
+// stage finishes what is queued in front of it and then closes its output. Must be joined before
+// it is destroyed.
+template <typename In>
+class Pipeline
+{
+public:
+   Pipeline(Pipeline &&) noexcept = default;
+   Pipeline & operator=(Pipeline &&) noexcept = default;
+
+   // Suspends while the first queue is full, returns false once the pipeline no longer accepts
+   // input. Coroutines not running on an executor are resumed on the thread of the first stage.
+   [[nodiscard]] auto Push(In item) { return PushAwaiter{m_input->Push({}), std::move(item)}; }
+
+   // Pushes all items with one lock acquisition per time the first queue is found full
+   [[nodiscard]] auto Push(std::span<In> items) { return m_input->Push(items); }
+
+   void Close() { m_input->Close(); }
+
+   // Cancels the workers at their next co_await, queued items are dropped. Closing the queues
+   // wakes the workers parked on them, so that Join() completes even on an idle pipeline.
+   void Stop()
+   {
+      m_scope->RequestStop();
+      for (auto & close : m_closers)
+         close();
+   }
+
+   // Resumes once all workers have exited, rethrows the first exception thrown by a stage
+   [[nodiscard]] auto Join() { return m_scope->Join(); }
+
+   std::size_t StageCount() const noexcept { return m_depths.size(); }
+
+   // Number of items waiting in front of a stage, stage 0 being the first one
+   std::size_t QueueDepth(std::size_t stage) const { return m_depths.at(stage)(); }
+
+private:
+   template <typename, typename>
+   friend class PipelineBuilder;
+
+   struct PushAwaiter
+   {
+      decltype(std::declval<internal::BoundedQueue<In> &>().Push({})) push;
+      In item;
+
+      bool await_ready() const noexcept { return false; }
+      template <typename P>
+      bool await_suspend(stdcr::coroutine_handle<P> h)
+      {
+         // the item lives in the awaiter, which doesn't move any more
+         push.items = std::span(&item, 1);
+         return push.await_suspend(h);
+      }
+      bool await_resume() const noexcept { return push.await_resume(); }
+   };
+
+   Pipeline(std::shared_ptr<internal::BoundedQueue<In>> input,
+            std::unique_ptr<AsyncScope> scope,
+            std::vector<std::function<std::size_t()>> depths,
+            std::vector<std::function<void()>> closers)
+      : m_input(std::move(input))
+      , m_scope(std::move(scope))
+      , m_depths(std::move(depths))
+      , m_closers(std::move(closers))
+   {}
+
+   std::shared_ptr<internal::BoundedQueue<In>> m_input;
+   std::unique_ptr<AsyncScope> m_scope;
+   std::vector<std::function<std::size_t()>> m_depths;
+   std::vector<std::function<void()>> m_closers;
+};
+
+// Adds stages one after another. A stage function takes an item and returns the next item or a
+// TaskHandle<Next, E> producing it, it is shared by the workers of its stage. Nothing runs until
+// Sink() has been called.
+template <typename In, typename Out>
+class PipelineBuilder
+{
+public:
+   template <typename F, Executor E = InlineExecutor>
+   auto Stage(F fn, StageOptions options = {}, E executor = {}) &&
+   {
+      using Next = internal::StageResultT<F, Out>;
+      static_assert(!std::is_void_v<Next>, "use Sink() for the last stage");
+
+      auto in = AddQueue(options);
+      auto out = std::make_shared<internal::BoundedQueue<Next>>(1);
+      auto fnPtr = std::make_shared<F>(std::move(fn));
+      auto live = std::make_shared<std::atomic<std::size_t>>(options.workers);
+      m_launchers.push_back([=](AsyncScope & scope) {
+         for (std::size_t i = 0; i < options.workers; ++i) {
+            scope.Spawn(executor, [=] {
+               internal::StageExit<Out, Next> exit(live, in, out);
+               return internal::StageWorker<E>(std::move(exit), fnPtr, options.batch);
+            });
+         }
+      });
+
+      PipelineBuilder<In, Next> next;
+      next.m_input = std::move(m_input);
+      next.m_launchers = std::move(m_launchers);
+      next.m_depths = std::move(m_depths);
+      next.m_closers = std::move(m_closers);
+      next.m_tail = std::move(out);
+      return next;
+   }
+
+   // fn takes an item and returns void or a TaskHandle<void, E>
+   template <typename F, Executor E = InlineExecutor>
+   Pipeline<In> Sink(F fn, StageOptions options = {}, E executor = {}) &&
+   {
+      auto in = AddQueue(options);
+      auto fnPtr = std::make_shared<F>(std::move(fn));
+      auto live = std::make_shared<std::atomic<std::size_t>>(options.workers);
+      m_launchers.push_back([=](AsyncScope & scope) {
+         for (std::size_t i = 0; i < options.workers; ++i) {
+            scope.Spawn(executor, [=] {
+               internal::StageExit<Out, Out> exit(live, in, nullptr);
+               return internal::SinkWorker<E>(std::move(exit), fnPtr, options.batch);
+            });
+         }
+      });
+
+      auto scope = std::make_unique<AsyncScope>();
+      for (auto & launch : m_launchers)
+         launch(*scope);
+      return Pipeline<In>(
+         std::move(m_input), std::move(scope), std::move(m_depths), std::move(m_closers));
+   }
+
+private:
+   template <typename, typename>
+   friend class PipelineBuilder;
+   template <typename T>
+   friend PipelineBuilder<T, T> MakePipeline();
+
+   PipelineBuilder() = default;
+
+   std::shared_ptr<internal::BoundedQueue<Out>> AddQueue(const StageOptions & options)
+   {
+      assert(options.workers > 0 && options.batch > 0);
+      m_tail->SetCapacity(options.capacity);
+      m_depths.push_back([queue = m_tail] { return queue->Depth(); });
+      m_closers.push_back([queue = m_tail] { queue->Close(); });
+      return m_tail;
+   }
+
+   std::shared_ptr<internal::BoundedQueue<In>> m_input;
+   std::shared_ptr<internal::BoundedQueue<Out>> m_tail;
+   std::vector<std::function<void(AsyncScope &)>> m_launchers;
+   std::vector<std::function<std::size_t()>> m_depths;
+   std::vector<std::function<void()>> m_closers;
+};
+
+template <typename In>
+PipelineBuilder<In, In> MakePipeline()
+{
+   PipelineBuilder<In, In> builder;
+   builder.m_input = std::make_shared<internal::BoundedQueue<In>>(1);
+   builder.m_tail = builder.m_input;
+   return builder;
+}
+
+} // namespace cr
+
+#endif
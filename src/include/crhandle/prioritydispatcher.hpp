@@ -0,0 +1,201 @@
+#ifndef PRIORITYDISPATCHER_HPP
+#define PRIORITYDISPATCHER_HPP
+
+#include "crhandle/coroutine.hpp"
+#include "crhandle/timeslice.hpp"
+#include "crhandle/uniquefunction.hpp"
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <utility>
+
+namespace cr {
+
+enum class Priority : std::uint8_t
+{
+   High,
+   Normal,
+   Low,
+};
+
+// Run queue with a few priority classes, drained by its owner. Tasks may be posted from any thread.
+// Non-empty classes take turns by smooth weighted round robin, so with the default weights a busy
+// high class gets 8 of every 13 turns and a low class is never starved.
+// The priority is a part of the executor, which Promise::await_transform copies to nested tasks, so
+// children inherit the priority of the task that awaits them.
+// With a non-zero time slice, a task that has been running for longer than that is reposted at its
+// next co_await even if the awaited operation is already complete (see Executor::ShouldYield()).
+class PriorityDispatcher
+{
+public:
+   static constexpr std::size_t ClassCount = 3;
+   using Weights = std::array<unsigned, ClassCount>;
+
+   struct Executor
+   {
+      PriorityDispatcher * dispatcher = nullptr;
+      Priority priority = Priority::Normal;
+
+      template <typename F>
+      void Execute(F && task) const
+      {
+         assert(dispatcher);
+         dispatcher->Post(priority, std::forward<F>(task));
+      }
+
+      void ExecuteBatch(std::span<stdcr::coroutine_handle<>> handles) const
+      {
+         assert(dispatcher);
+         dispatcher->PostBatch(priority, handles);
+      }
+
+      // Queried by Promise before continuing synchronously past a co_await
+      bool ShouldYield() const noexcept { return dispatcher && dispatcher->m_slice.Exceeded(); }
+
+      // True on the thread draining the dispatcher while it runs a task of the same priority
+      bool RunningInThisThread() const noexcept
+      {
+         return dispatcher && dispatcher->IsRunning(priority);
+      }
+
+      Executor WithPriority(Priority p) const noexcept { return Executor{dispatcher, p}; }
+
+      bool operator==(const Executor &) const = default;
+   };
+
+   explicit PriorityDispatcher(Weights weights = {8, 4, 1},
+                               std::chrono::microseconds timeSlice = {})
+      : m_weights(weights)
+      , m_slice(timeSlice)
+   {
+      for ([[maybe_unused]] unsigned weight : m_weights)
+         assert(weight > 0);
+   }
+
+   PriorityDispatcher(const PriorityDispatcher &) = delete;
+   PriorityDispatcher & operator=(const PriorityDispatcher &) = delete;
+
+   Executor GetExecutor(Priority priority = Priority::Normal) noexcept
+   {
+      return Executor{this, priority};
+   }
+
+   template <typename F>
+   void Post(Priority priority, F && task)
+   {
+      std::lock_guard lock(m_mutex);
+      m_queues[Index(priority)].emplace_back(std::forward<F>(task));
+   }
+
+   // Queues all handles under a single lock
+   void PostBatch(Priority priority, std::span<stdcr::coroutine_handle<>> handles)
+   {
+      std::lock_guard lock(m_mutex);
+      auto & queue = m_queues[Index(priority)];
+      for (stdcr::coroutine_handle<> h : handles)
+         queue.emplace_back(h);
+   }
+
+   bool ProcessOneTask()
+   {
+      internal::UniqueFunction task;
+      std::size_t cls;
+      {
+         std::lock_guard lock(m_mutex);
+         cls = PickClass();
+         if (cls == ClassCount)
+            return false;
+         task = std::move(m_queues[cls].front());
+         m_queues[cls].pop_front();
+      }
+      m_slice.Start();
+      RunningScope running(this, static_cast<Priority>(cls));
+      task();
+      return true;
+   }
+
+   std::size_t ProcessAll()
+   {
+      std::size_t count = 0;
+      while (ProcessOneTask())
+         ++count;
+      return count;
+   }
+
+   std::size_t Pending(Priority priority) const
+   {
+      std::lock_guard lock(m_mutex);
+      return m_queues[Index(priority)].size();
+   }
+
+private:
+   // Marks the calling thread as running a task of the given class, restores the previous state
+   // when leaving a nested ProcessOneTask()
+   class RunningScope
+   {
+   public:
+      RunningScope(const PriorityDispatcher * dispatcher, Priority priority) noexcept
+         : m_prevDispatcher(std::exchange(t_running, dispatcher))
+         , m_prevPriority(std::exchange(t_runningPriority, priority))
+      {}
+      ~RunningScope()
+      {
+         t_running = m_prevDispatcher;
+         t_runningPriority = m_prevPriority;
+      }
+
+   private:
+      const PriorityDispatcher * m_prevDispatcher;
+      Priority m_prevPriority;
+   };
+
+   static std::size_t Index(Priority priority) noexcept
+   {
+      return static_cast<std::size_t>(priority);
+   }
+
+   bool IsRunning(Priority priority) const noexcept
+   {
+      return t_running == this && t_runningPriority == priority;
+   }
+
+   // Returns ClassCount if all queues are empty
+   std::size_t PickClass() noexcept
+   {
+      long total = 0;
+      std::size_t best = ClassCount;
+      for (std::size_t i = 0; i < ClassCount; ++i) {
+         if (m_queues[i].empty()) {
+            m_credits[i] = 0;
+            continue;
+         }
+         const auto weight = static_cast<long>(m_weights[i]);
+         total += weight;
+         m_credits[i] += weight;
+         if (best == ClassCount || m_credits[i] > m_credits[best])
+            best = i;
+      }
+      if (best != ClassCount)
+         m_credits[best] -= total;
+      return best;
+   }
+
+   const Weights m_weights;
+   internal::TimeSlice m_slice;
+   mutable std::mutex m_mutex;
+   std::array<std::deque<internal::UniqueFunction>, ClassCount> m_queues;
+   std::array<long, ClassCount> m_credits{};
+
+   static inline thread_local const PriorityDispatcher * t_running = nullptr;
+   static inline thread_local Priority t_runningPriority = Priority::Normal;
+};
+
+} // namespace cr
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef SHAREDTASK_HPP
+#define SHAREDTASK_HPP
+
+#include "crhandle/detachedhandle.hpp"
+#include "crhandle/taskhandle.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace cr {
+
+// A task that may be co_awaited by any number of coroutines, e.g. to fetch some configuration once
+// for all requests that need it. The wrapped task is started on the first co_await and runs to
+// completion regardless of its awaiters being canceled. Its result is kept for as long as any copy
+// of the SharedTask lives and is handed out by const reference. Awaiters are linked through nodes
+// embedded in their awaiter objects. On completion each one is resumed through the executor of the
+// task that awaits it, or inline if it is not awaited from a TaskHandle.
+template <TaskResult T, Executor E = InlineExecutor>
+class SharedTask
+{
+   struct State;
+
+public:
+   SharedTask() = default;
+
+   // The task is started on executor when first awaited
+   explicit SharedTask(TaskHandle<T, E> && task, E executor = {})
+      : m_state(std::make_shared<State>(std::move(task), std::move(executor)))
+   {}
+
+   explicit operator bool() const noexcept { return m_state != nullptr; }
+   bool Done() const noexcept { return m_state && m_state->Done(); }
+   bool Failed() const noexcept
+   {
+      return Done() && std::holds_alternative<std::exception_ptr>(m_state->result);
+   }
+
+   // Awaits the result as const T & (or void), rethrows the exception thrown by the task
+   [[nodiscard]] auto Get() const noexcept
+   {
+      assert(m_state);
+      return Awaiter{{}, m_state};
+   }
+
+private:
+   struct Waiter
+   {
+      Waiter * next = nullptr;
+      stdcr::coroutine_handle<> handle = nullptr;
+      std::optional<E> executor;
+   };
+
+   struct Awaiter : Waiter
+   {
+      std::shared_ptr<State> state;
+
+      bool await_ready() const noexcept { return state->Done(); }
+      template <typename P>
+      bool await_suspend(stdcr::coroutine_handle<P> h)
+      {
+         if constexpr (requires {
+                          { h.promise().Executor() } -> std::convertible_to<const E &>;
+                       })
+            this->executor.emplace(h.promise().Executor());
+         this->handle = h;
+         return state->Suspend(*this);
+      }
+      decltype(auto) await_resume() const { return state->Result(); }
+   };
+
+   struct State : std::enable_shared_from_this<State>
+   {
+      State(TaskHandle<T, E> && task, E && executor)
+         : task(std::move(task))
+         , executor(std::move(executor))
+      {}
+
+      bool Done() const noexcept { return waiters.load(std::memory_order_acquire) == DoneMarker(); }
+
+      // Starts the task if nobody has, then registers w unless the task is already done
+      bool Suspend(Waiter & w)
+      {
+         if (!started.exchange(true, std::memory_order_acq_rel))
+            Drive(this->shared_from_this(), std::move(task), executor);
+
+         Waiter * head = waiters.load(std::memory_order_acquire);
+         do {
+            if (head == DoneMarker())
+               return false;
+            w.next = head;
+         } while (!waiters.compare_exchange_weak(
+            head, &w, std::memory_order_release, std::memory_order_acquire));
+         return true;
+      }
+
+      decltype(auto) Result() const
+      {
+         if (const auto * exptr = std::get_if<std::exception_ptr>(&result))
+            std::rethrow_exception(*exptr);
+         if constexpr (!std::is_void_v<T>)
+            return static_cast<const T &>(std::get<T>(result));
+      }
+
+      void Complete()
+      {
+         Waiter * head = waiters.exchange(DoneMarker(), std::memory_order_acq_rel);
+         // resume in the order of arrival
+         Waiter * ordered = nullptr;
+         while (head) {
+            Waiter * next = head->next;
+            head->next = ordered;
+            ordered = head;
+            head = next;
+         }
+         while (ordered) {
+            // the node lives in the awaiter, which is gone once its coroutine resumes, possibly
+            // on another thread before Execute() returns, so nothing of it is used from there on
+            Waiter * next = ordered->next;
+            const stdcr::coroutine_handle<> handle = ordered->handle;
+            if (ordered->executor) {
+               E executor = *ordered->executor;
+               executor.Execute(handle);
+            } else {
+               handle.resume();
+            }
+            ordered = next;
+         }
+      }
+
+      static DetachedHandle Drive(std::shared_ptr<State> self, TaskHandle<T, E> task, E executor)
+      {
+         try {
+            if constexpr (std::is_void_v<T>)
+               co_await task.Run(executor);
+            else
+               self->result.template emplace<T>(co_await task.Run(executor));
+         }
+         catch (...) {
+            self->result.template emplace<std::exception_ptr>(std::current_exception());
+         }
+         self->Complete();
+      }
+
+      // Never dereferenced, marks a completed task in place of the list head
+      Waiter * DoneMarker() const noexcept
+      {
+         return reinterpret_cast<Waiter *>(const_cast<std::atomic<Waiter *> *>(&waiters));
+      }
+
+      TaskHandle<T, E> task;
+      E executor;
+      std::atomic<bool> started = false;
+      std::atomic<Waiter *> waiters = nullptr;
+      typename internal::ValueHolder<T>::VariantType result;
+   };
+
+   std::shared_ptr<State> m_state;
+};
+
+} // namespace cr
+
+#endif
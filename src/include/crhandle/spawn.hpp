@@ -0,0 +1,229 @@
+#ifndef SPAWN_HPP
+#define SPAWN_HPP
+
+#include "crhandle/taskhandle.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cr {
+
+namespace internal {
+
+// Number of outstanding tasks, with coroutines waiting for it to drop to zero
+class TaskCounter
+{
+public:
+   TaskCounter() = default;
+   TaskCounter(const TaskCounter &) = delete;
+   TaskCounter & operator=(const TaskCounter &) = delete;
+
+   void Acquire() noexcept { m_count.fetch_add(1, std::memory_order_relaxed); }
+
+   // Resumes the waiters on the calling thread if this was the last task. The last decrement is
+   // done under the lock, which a joiner takes before it may see zero and destroy the counter, so
+   // nothing here touches the counter once it has been observed at zero.
+   void Release() noexcept
+   {
+      std::size_t count = m_count.load(std::memory_order_relaxed);
+      while (count > 1) {
+         if (m_count.compare_exchange_weak(
+                count, count - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+            return;
+      }
+
+      std::vector<stdcr::coroutine_handle<>> waiters;
+      {
+         std::lock_guard lock(m_mutex);
+         // something might have been started in the meantime
+         if (m_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+         waiters.swap(m_waiters);
+      }
+      for (auto h : waiters)
+         h.resume();
+   }
+
+   std::size_t Count() const noexcept { return m_count.load(std::memory_order_acquire); }
+
+   auto WhenZero()
+   {
+      struct Awaiter
+      {
+         TaskCounter & counter;
+
+         // Zero is only trusted under the lock, see Release()
+         bool await_ready() const noexcept { return false; }
+         bool await_suspend(stdcr::coroutine_handle<> h)
+         {
+            std::lock_guard lock(counter.m_mutex);
+            if (counter.Count() == 0)
+               return false;
+            counter.m_waiters.push_back(h);
+            return true;
+         }
+         void await_resume() const noexcept {}
+      };
+      return Awaiter{*this};
+   }
+
+private:
+   std::atomic<std::size_t> m_count{0};
+   std::mutex m_mutex;
+   std::vector<stdcr::coroutine_handle<>> m_waiters;
+};
+
+template <Executor E, typename G>
+struct SpawnPromise;
+
+template <typename G>
+struct SpawnFinalizer
+{
+   G & group;
+
+   bool await_ready() const noexcept { return false; }
+   void await_suspend(stdcr::coroutine_handle<> h) const noexcept
+   {
+      G & g = group;
+      h.destroy();
+      g.Release();
+   }
+   void await_resume() const noexcept {}
+};
+
+template <Executor E, typename G>
+struct SpawnedTask
+{
+   using promise_type = SpawnPromise<E, G>;
+
+   stdcr::coroutine_handle<promise_type> handle;
+};
+
+// Root frame of a task spawned into a group G. Started lazily through the executor, destroys
+// itself when done and reports exceptions to the group instead of the coroutine that resumed it.
+template <Executor E, typename G>
+struct SpawnPromise : private E
+{
+   G & group;
+
+   template <typename F>
+   SpawnPromise(G & g, const E & executor, F &)
+      : E(executor)
+      , group(g)
+   {}
+
+   static void * operator new(std::size_t size) { return AllocatePooledFrame(size); }
+   static void operator delete(void * frame, std::size_t size) noexcept
+   {
+      DeallocatePooledFrame(frame, size);
+   }
+
+   SpawnedTask<E, G> get_return_object() noexcept
+   {
+      return {stdcr::coroutine_handle<SpawnPromise>::from_promise(*this)};
+   }
+   stdcr::suspend_always initial_suspend() const noexcept { return {}; }
+   SpawnFinalizer<G> final_suspend() const noexcept { return {group}; }
+   void unhandled_exception() noexcept { group.HandleException(std::current_exception()); }
+   void return_void() const noexcept {}
+
+   template <TaskResult T>
+   auto await_transform(TaskHandle<T, E> && task)
+   {
+      return task.Run(static_cast<const E &>(*this), group.StopFlag());
+   }
+   template <Awaiter A>
+   decltype(auto) await_transform(A && a)
+   {
+      return std::forward<A>(a);
+   }
+};
+
+template <typename G, Executor E, typename F>
+SpawnedTask<E, G> SpawnRoot(G &, E, F fn)
+{
+   co_await std::invoke(fn);
+}
+
+} // namespace internal
+
+// Fire-and-forget tasks with shutdown support. Tracks the number of outstanding spawned tasks so
+// that their owner can co_await WhenIdle() before tearing down, and hands exceptions escaping the
+// tasks to a handler (std::terminate() if none). Spawning and completion are thread safe.
+class SpawnGroup
+{
+public:
+   using ExceptionHandler = std::function<void(std::exception_ptr)>;
+
+   explicit SpawnGroup(ExceptionHandler handler = {})
+      : m_handler(std::move(handler))
+   {}
+
+   SpawnGroup(const SpawnGroup &) = delete;
+   SpawnGroup & operator=(const SpawnGroup &) = delete;
+
+   ~SpawnGroup() { assert(Outstanding() == 0); }
+
+   // Used by cr::Spawn(executor, fn)
+   static SpawnGroup & Default()
+   {
+      static SpawnGroup s_group;
+      return s_group;
+   }
+
+   // Must be set before anything is spawned
+   void SetExceptionHandler(ExceptionHandler handler) { m_handler = std::move(handler); }
+
+   // Posts a task that co_awaits fn(), which returns a TaskHandle<T, E> or any other awaiter. The
+   // root frame comes from the per-thread frame cache, thus spawning at a steady rate doesn't
+   // allocate.
+   template <Executor E, typename F>
+   void Spawn(E executor, F && fn)
+   {
+      auto task = internal::SpawnRoot(*this, executor, std::decay_t<F>(std::forward<F>(fn)));
+      m_outstanding.Acquire();
+      executor.Execute(task.handle);
+   }
+
+   std::size_t Outstanding() const noexcept { return m_outstanding.Count(); }
+
+   // Resumes the awaiting coroutine once no spawned task is outstanding, on the thread that
+   // finished the last one
+   [[nodiscard]] auto WhenIdle() { return m_outstanding.WhenZero(); }
+
+private:
+   template <Executor, typename>
+   friend struct internal::SpawnPromise;
+   template <typename>
+   friend struct internal::SpawnFinalizer;
+
+   const bool * StopFlag() const noexcept { return nullptr; }
+   void Release() noexcept { m_outstanding.Release(); }
+
+   void HandleException(std::exception_ptr exception) noexcept
+   {
+      if (!m_handler)
+         std::terminate();
+      m_handler(std::move(exception));
+   }
+
+   ExceptionHandler m_handler;
+   internal::TaskCounter m_outstanding;
+};
+
+template <Executor E, typename F>
+void Spawn(E executor, F && fn)
+{
+   SpawnGroup::Default().Spawn(std::move(executor), std::forward<F>(fn));
+}
+
+} // namespace cr
+
+#endif
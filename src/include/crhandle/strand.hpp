@@ -0,0 +1,171 @@
+#ifndef STRAND_HPP
+#define STRAND_HPP
+
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/uniquefunction.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace cr {
+
+namespace internal {
+
+// Multi-producer single-consumer queue of closures (D. Vyukov's intrusive node-based queue).
+// Push() is wait-free. Pop() is called only by the strand draining the queue, after the pending
+// counter has shown that a node was pushed, and spins for the short window in which a producer has
+// claimed the head but not yet linked its node.
+class MpscQueue
+{
+public:
+   MpscQueue() noexcept
+      : m_head(&m_stub)
+      , m_tail(&m_stub)
+   {}
+
+   MpscQueue(const MpscQueue &) = delete;
+   MpscQueue & operator=(const MpscQueue &) = delete;
+
+   ~MpscQueue()
+   {
+      Node * node = m_tail;
+      while (node) {
+         Node * next = node->next.load(std::memory_order_relaxed);
+         if (node != &m_stub)
+            delete node;
+         node = next;
+      }
+   }
+
+   template <typename F>
+   void Push(F && f)
+   {
+      Node * node = new Node{{nullptr}, UniqueFunction(std::forward<F>(f))};
+      Node * prev = m_head.exchange(node, std::memory_order_acq_rel);
+      prev->next.store(node, std::memory_order_release);
+   }
+
+   UniqueFunction Pop() noexcept
+   {
+      Node * tail = m_tail;
+      Node * next = tail->next.load(std::memory_order_acquire);
+      while (!next) {
+         std::this_thread::yield();
+         next = tail->next.load(std::memory_order_acquire);
+      }
+      // the popped node stays as the new stub, producers may still be linking to it
+      m_tail = next;
+      if (tail != &m_stub)
+         delete tail;
+      return std::move(next->fn);
+   }
+
+private:
+   struct Node
+   {
+      std::atomic<Node *> next;
+      UniqueFunction fn;
+   };
+
+   Node m_stub{{nullptr}, {}};
+   std::atomic<Node *> m_head;
+   Node * m_tail;
+};
+
+} // namespace internal
+
+// Executor wrapper that never runs two of its tasks at the same time, even on a multi-threaded
+// executor, so that state touched only from a strand needs no mutex. Tasks run in the order they
+// were posted. Posting is lock-free: the first post to an idle strand schedules a drain on the
+// underlying executor, later ones only push to the queue. A drain runs at most MaxBatch tasks
+// before it reposts itself, to let other work on the underlying executor make progress.
+// Copies of a Strand share the queue. A default-constructed Strand can't run anything, it only
+// exists to satisfy cr::Executor and must be assigned before use.
+template <Executor E>
+class Strand
+{
+public:
+   static constexpr std::size_t MaxBatch = 64;
+
+   Strand() noexcept = default;
+
+   explicit Strand(E executor)
+      : m_state(std::make_shared<State>(std::move(executor)))
+   {}
+
+   template <typename F>
+   void Execute(F && f) const
+   {
+      assert(m_state);
+      m_state->Post(m_state, std::forward<F>(f));
+   }
+
+   // True while the calling thread runs a task of this strand, i.e. work may be dispatched in place
+   bool RunningInThisThread() const noexcept { return m_state && t_running == m_state.get(); }
+
+   bool operator==(const Strand &) const = default;
+
+private:
+   struct State
+   {
+      explicit State(E executor)
+         : executor(std::move(executor))
+      {}
+
+      template <typename F>
+      void Post(const std::shared_ptr<State> & self, F && f)
+      {
+         queue.Push(std::forward<F>(f));
+         if (pending.fetch_add(1, std::memory_order_acq_rel) == 0)
+            Schedule(self);
+      }
+
+      void Schedule(std::shared_ptr<State> self)
+      {
+         executor.Execute([self = std::move(self)] {
+            self->Drain(self);
+         });
+      }
+
+      void Drain(const std::shared_ptr<State> & self)
+      {
+         const State * prevRunning = std::exchange(t_running, this);
+         struct RunningGuard
+         {
+            const State * prev;
+            ~RunningGuard() { t_running = prev; }
+         } guard{prevRunning};
+
+         for (std::size_t i = 0; i < MaxBatch; ++i) {
+            internal::UniqueFunction task = queue.Pop();
+            try {
+               task();
+            }
+            catch (...) {
+               if (pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                  Schedule(self);
+               throw;
+            }
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+               return;
+         }
+         Schedule(self);
+      }
+
+      E executor;
+      internal::MpscQueue queue;
+      std::atomic<std::size_t> pending = 0;
+   };
+
+   static inline thread_local const State * t_running = nullptr;
+
+   std::shared_ptr<State> m_state;
+};
+
+} // namespace cr
+
+#endif
@@ -2,12 +2,20 @@
 #define TASKHANDLE_HPP
 
 #include "crhandle/coroutine.hpp"
+#include "crhandle/framecache.hpp"
+#include "crhandle/tasklocal.hpp"
 
+#include <array>
+#include <atomic>
 #include <concepts>
+#include <cstddef>
 #include <exception>
 #include <functional>
+#include <span>
 #include <type_traits>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace cr {
 
@@ -72,15 +80,84 @@ namespace internal {
 
 template <TaskResult T, Executor E>
 struct Promise;
+
+struct TaskLauncher;
+
+// Executors that accept several coroutines at once, e.g. to take their queue lock only once
+template <typename E>
+concept BatchExecutor = requires (E & e, std::span<stdcr::coroutine_handle<>> handles) {
+   e.ExecuteBatch(handles);
+};
+
+// Executors that know whether the calling thread is running one of their tasks right now, in which
+// case a coroutine may be resumed in place instead of being posted (see cr::Dispatch())
+template <typename E>
+concept DispatchingExecutor = requires (const E & e) {
+   { e.RunningInThisThread() } -> std::convertible_to<bool>;
+};
+
+// Executors that enforce a time-slice budget force a yield at the next co_await once it runs out
+template <typename E>
+concept TimeSlicedExecutor = requires (const E & e) {
+   { e.ShouldYield() } -> std::convertible_to<bool>;
+};
 } // namespace internal
 
 // clang-format on
 
+// Posts all handles to executor, with a single ExecuteBatch() call if the executor supports it
+template <Executor E>
+void ExecuteBatch(E & executor, std::span<stdcr::coroutine_handle<>> handles)
+{
+   if constexpr (internal::BatchExecutor<E>) {
+      executor.ExecuteBatch(handles);
+   } else {
+      for (stdcr::coroutine_handle<> h : handles)
+         executor.Execute(h);
+   }
+}
+
+namespace internal {
+
+inline constexpr unsigned MaxDispatchDepth = 32;
+inline thread_local unsigned t_dispatchDepth = 0;
+
+} // namespace internal
+
+// Runs f right away if the calling thread is already running a task of executor, posts it
+// otherwise. Dispatches nested deeper than MaxDispatchDepth are posted to bound the stack.
+template <Executor E, typename F>
+void Dispatch(E & executor, F && f)
+{
+   if constexpr (internal::DispatchingExecutor<E>) {
+      if (internal::t_dispatchDepth < internal::MaxDispatchDepth &&
+          executor.RunningInThisThread()) {
+         struct DepthGuard
+         {
+            DepthGuard() noexcept { ++internal::t_dispatchDepth; }
+            ~DepthGuard() { --internal::t_dispatchDepth; }
+         } guard;
+         std::invoke(std::forward<F>(f));
+         return;
+      }
+   }
+   executor.Execute(std::forward<F>(f));
+}
+
 struct CanceledException : std::exception
 {
    const char * what() const noexcept override { return "Coroutine canceled"; }
 };
 
+// co_await Yield() reposts the current task to its executor, letting other queued work run first
+struct YieldAwaitable
+{};
+
+inline constexpr YieldAwaitable Yield() noexcept
+{
+   return {};
+}
+
 template <TaskResult T, Executor E = InlineExecutor>
 struct TaskHandle
 {
@@ -99,38 +176,59 @@ struct TaskHandle
    void Swap(TaskHandle & other) noexcept;
 
 private:
+   template <TaskResult, Executor>
+   friend struct internal::Promise;
+   friend struct internal::TaskLauncher;
+
+   handle_type Prepare(E executor, const bool * parentCanceled);
+   template <typename P>
+   auto RunAsChildOf(const P & parent);
+   static auto Start(handle_type handle);
+
    handle_type m_handle;
 };
 
 
 namespace internal {
 
+// The result is stored in a base rather than a member so that the first member of Promise can be
+// placed in the tail padding after the variant index (Itanium ABI), which keeps the frame smaller.
 template <TaskResult T>
-struct ValueHolder
+struct ValueHolder : std::variant<std::monostate, T, std::exception_ptr>
 {
+   using VariantType = std::variant<std::monostate, T, std::exception_ptr>;
+
    template <typename U>
    void return_value(U && val)
    {
-      value.template emplace<T>(std::forward<U>(val));
+      this->template emplace<T>(std::forward<U>(val));
    }
-   T RetrieveValue() { return std::get<T>(std::move(value)); }
+   T RetrieveValue() { return std::get<T>(std::move(Value())); }
 
-   std::variant<std::monostate, T, std::exception_ptr> value;
+   VariantType & Value() noexcept { return *this; }
 };
 
 template <>
-struct ValueHolder<void>
+struct ValueHolder<void> : std::variant<std::monostate, std::exception_ptr>
 {
+   using VariantType = std::variant<std::monostate, std::exception_ptr>;
+
    void return_void() const noexcept {}
    void RetrieveValue() const noexcept {}
 
-   std::variant<std::monostate, std::exception_ptr> value;
+   VariantType & Value() noexcept { return *this; }
 };
 
+template <typename E>
+inline constexpr bool IsInlineExecutor = std::is_same_v<E, InlineExecutor>;
+
+template <TaskResult T, Executor E>
+struct InlineChildAwaiter;
+
 template <TaskResult T, Executor E>
 struct Promise
-   : public ValueHolder<T>
-   , private E
+   : private E
+   , public ValueHolder<T>
 {
    template <Awaiter A>
    struct CancelingAwaiter : A
@@ -138,7 +236,7 @@ struct Promise
       const Promise & p;
       decltype(auto) await_resume()
       {
-         if (p.canceled || (p.parentCanceled && *p.parentCanceled))
+         if (p.IsCanceled() || p.Expired())
             throw CanceledException{};
          return A::await_resume();
       }
@@ -146,14 +244,122 @@ struct Promise
    template <Awaiter A>
    CancelingAwaiter(A &&, const Promise &) -> CancelingAwaiter<std::remove_reference_t<A>>;
 
+   // Suspends and reposts the task instead of continuing synchronously if its time slice is over
+   template <Awaiter A>
+   struct BudgetAwaiter : A
+   {
+      const Promise & p;
+      bool yielding = false;
+
+      bool await_ready()
+      {
+         if (!A::await_ready())
+            return false;
+         yielding = p.Executor().ShouldYield();
+         return !yielding;
+      }
+      template <typename H>
+      stdcr::coroutine_handle<> await_suspend(H h)
+      {
+         if (yielding) {
+            E executor = p.Executor();
+            executor.Execute(h);
+            return stdcr::noop_coroutine();
+         }
+         using R = decltype(A::await_suspend(h));
+         if constexpr (std::is_void_v<R>) {
+            A::await_suspend(h);
+            return stdcr::noop_coroutine();
+         } else if constexpr (std::is_same_v<R, bool>) {
+            if (A::await_suspend(h))
+               return stdcr::noop_coroutine();
+            return h;
+         } else {
+            return A::await_suspend(h);
+         }
+      }
+   };
+   template <Awaiter A>
+   BudgetAwaiter(A &&, const Promise &) -> BudgetAwaiter<std::remove_reference_t<A>>;
+
+   struct YieldAwaiter
+   {
+      const Promise & p;
+
+      bool await_ready() const noexcept { return IsInlineExecutor<E>; }
+      void await_suspend(stdcr::coroutine_handle<> h) const
+      {
+         E executor = p.Executor();
+         executor.Execute(h);
+      }
+      void await_resume() const noexcept {}
+   };
+
    bool canceled = false;
-   const bool * parentCanceled = nullptr;
+   bool hasContext = false;
+   // Flag of the cancelation root, or the TaskContext of a task-local binding if hasContext
+   const void * parentLink = nullptr;
    stdcr::coroutine_handle<> parentHandle = nullptr;
 
+#if defined(CRHANDLE_FRAME_STATS) || defined(CRHANDLE_FRAME_CACHE)
+   static void * operator new(std::size_t size) { return AllocateFrame(size); }
+   static void operator delete(void * frame, std::size_t size) noexcept
+   {
+      DeallocateFrame(frame, size);
+   }
+#endif
+
+   const TaskContext * Context() const noexcept
+   {
+      return hasContext ? static_cast<const TaskContext *>(parentLink) : nullptr;
+   }
+   const bool * ParentCanceled() const noexcept
+   {
+      return hasContext ? Context()->Canceled() : static_cast<const bool *>(parentLink);
+   }
+   const TaskLocals * Locals() const noexcept { return hasContext ? Context()->locals : nullptr; }
+   void SetParentCanceled(const bool * flag) noexcept
+   {
+      hasContext = false;
+      parentLink = flag;
+   }
+   // The children started from now on see the given context, which must outlive them
+   void EnterContext(const TaskContext & context) noexcept
+   {
+      hasContext = true;
+      parentLink = &context;
+   }
+   // Shares the cancelation root and the task-locals of the parent
+   template <typename P>
+   void InheritFrom(const P & parent) noexcept
+   {
+      hasContext = parent.hasContext;
+      parentLink = parent.hasContext ? parent.parentLink : &parent.CancelationFlag();
+   }
+
    const bool & CancelationFlag() const noexcept
    {
+      const bool * parentCanceled = ParentCanceled();
       return parentCanceled ? *parentCanceled : canceled;
    }
+   bool IsCanceled() const noexcept
+   {
+      // the flag of a root task may be shared with other threads, e.g. by AsyncScope::RequestStop()
+      const bool * parentCanceled = ParentCanceled();
+      return canceled ||
+             (parentCanceled &&
+              std::atomic_ref(const_cast<bool &>(*parentCanceled)).load(std::memory_order_relaxed));
+   }
+   // Executors may cancel the tasks they resume, e.g. when a deadline has been missed
+   bool Expired() const noexcept
+   {
+      if constexpr (requires(const E & e) {
+                       { e.Expired() } -> std::convertible_to<bool>;
+                    })
+         return Executor().Expired();
+      else
+         return false;
+   }
    const E & Executor() const noexcept { return static_cast<const E &>(*this); }
    E & Executor() noexcept { return static_cast<E &>(*this); }
 
@@ -161,19 +367,77 @@ struct Promise
 
    void unhandled_exception() noexcept
    {
-      this->value.template emplace<std::exception_ptr>(std::current_exception());
+      this->template emplace<std::exception_ptr>(std::current_exception());
+   }
+
+   T Result()
+   {
+      if (const auto * exptr = std::get_if<std::exception_ptr>(&this->Value()))
+         std::rethrow_exception(*exptr);
+      return this->RetrieveValue();
    }
 
    template <Awaiter A>
    auto await_transform(A && awaiter) const
    {
-      return CancelingAwaiter{std::forward<A>(awaiter), *this};
+      if constexpr (TimeSlicedExecutor<E>)
+         return CancelingAwaiter{BudgetAwaiter{std::forward<A>(awaiter), *this}, *this};
+      else
+         return CancelingAwaiter{std::forward<A>(awaiter), *this};
+   }
+
+   auto await_transform(YieldAwaitable) const
+   {
+      return CancelingAwaiter{YieldAwaiter{*this}, *this};
+   }
+
+   template <typename V>
+   auto await_transform(TaskLocalGet<V> get) const
+   {
+      struct GetAwaiter
+      {
+         const TaskLocals * locals;
+         std::size_t id;
+
+         bool await_ready() const noexcept { return true; }
+         void await_suspend(stdcr::coroutine_handle<>) const noexcept {}
+         // only looked up once the task is known not to be canceled, the values might be gone then
+         const V * await_resume() const noexcept
+         {
+            return static_cast<const V *>(locals ? locals->Find(id) : nullptr);
+         }
+      };
+      return CancelingAwaiter{GetAwaiter{Locals(), get.id}, *this};
+   }
+
+   template <typename V>
+   auto await_transform(TaskLocalBind<V> && bind)
+   {
+      struct BindAwaiter
+      {
+         Promise & p;
+         TaskLocalBind<V> bind;
+
+         bool await_ready() const noexcept { return true; }
+         void await_suspend(stdcr::coroutine_handle<>) const noexcept {}
+         TaskLocalBinding<V> await_resume() { return {p, std::move(bind)}; }
+      };
+      return CancelingAwaiter{BindAwaiter{*this, std::move(bind)}, *this};
    }
 
    template <TaskResult R>
    auto await_transform(TaskHandle<R, E> && innerTask) const
    {
-      return CancelingAwaiter{innerTask.Run(Executor(), &CancelationFlag()), *this};
+      if constexpr (IsInlineExecutor<E>) {
+         auto handle = std::exchange(innerTask.m_handle, nullptr);
+         handle.promise().InheritFrom(*this);
+         return CancelingAwaiter{InlineChildAwaiter<R, E>{handle}, *this};
+      } else if constexpr (TimeSlicedExecutor<E>) {
+         auto child = innerTask.RunAsChildOf(*this);
+         return CancelingAwaiter{BudgetAwaiter{std::move(child), *this}, *this};
+      } else {
+         return CancelingAwaiter{innerTask.RunAsChildOf(*this), *this};
+      }
    }
 
    auto initial_suspend() noexcept { return CancelingAwaiter{stdcr::suspend_always{}, *this}; }
@@ -185,10 +449,23 @@ struct Promise
          Promise & p;
 
          bool await_ready() const noexcept { return p.canceled; }
-         void await_suspend(stdcr::coroutine_handle<>) noexcept
+         auto await_suspend(stdcr::coroutine_handle<>) noexcept
          {
-            if (p.parentHandle)
-               p.Execute(p.parentHandle);
+            if constexpr (IsInlineExecutor<E>) {
+               stdcr::coroutine_handle<> next = stdcr::noop_coroutine();
+               if (p.parentHandle)
+                  next = p.parentHandle;
+               return next;
+            } else {
+               // The parent may destroy this frame once posted, while Execute() is still running,
+               // so the executor and the handle are copied out of it first.
+               // Symmetric transfer would be cheaper, but isn't a tail call in unoptimized builds.
+               if (p.parentHandle) {
+                  E executor = p.Executor();
+                  stdcr::coroutine_handle<> parent = p.parentHandle;
+                  cr::Dispatch(executor, parent);
+               }
+            }
          }
          void await_resume() const noexcept {}
       };
@@ -196,6 +473,38 @@ struct Promise
    }
 };
 
+// Awaiter for a child task that is co_awaited directly with an InlineExecutor. A child that
+// completes synchronously doesn't suspend the parent at all, otherwise it resumes the parent by
+// symmetric transfer. The awaiter owns the child frame and destroys it on every path out of the
+// co_await expression, so the frame never escapes and is eligible for heap allocation elision.
+template <TaskResult T, Executor E>
+struct InlineChildAwaiter
+{
+   using handle_type = stdcr::coroutine_handle<Promise<T, E>>;
+
+   handle_type handle;
+
+   explicit InlineChildAwaiter(handle_type h) noexcept
+      : handle(h)
+   {}
+   InlineChildAwaiter(InlineChildAwaiter && other) noexcept
+      : handle(std::exchange(other.handle, nullptr))
+   {}
+   ~InlineChildAwaiter()
+   {
+      if (handle)
+         handle.destroy();
+   }
+
+   bool await_ready() const
+   {
+      handle.resume();
+      return handle.done();
+   }
+   void await_suspend(stdcr::coroutine_handle<> h) noexcept { handle.promise().parentHandle = h; }
+   T await_resume() { return handle.promise().Result(); }
+};
+
 } // namespace internal
 
 template <TaskResult T, Executor E>
@@ -245,9 +554,23 @@ TaskHandle<T, E>::operator bool() const noexcept
 template <TaskResult T, Executor E>
 auto TaskHandle<T, E>::Run(E executor, const bool * parentCanceled)
 {
-   m_handle.promise().Executor() = executor;
-   m_handle.promise().parentCanceled = parentCanceled;
-   m_handle.promise().Executor().Execute(m_handle);
+   // running the task might relocate or destroy this TaskHandle, e.g. in a container
+   return Start(Prepare(std::move(executor), parentCanceled));
+}
+
+template <TaskResult T, Executor E>
+template <typename P>
+auto TaskHandle<T, E>::RunAsChildOf(const P & parent)
+{
+   handle_type handle = Prepare(parent.Executor(), nullptr);
+   handle.promise().InheritFrom(parent);
+   return Start(handle);
+}
+
+template <TaskResult T, Executor E>
+auto TaskHandle<T, E>::Start(handle_type handle)
+{
+   Dispatch(handle.promise().Executor(), handle);
 
    struct Awaiter
    {
@@ -255,25 +578,64 @@ auto TaskHandle<T, E>::Run(E executor, const bool * parentCanceled)
 
       bool await_ready() const noexcept { return handle.done(); }
       void await_suspend(stdcr::coroutine_handle<> h) { handle.promise().parentHandle = h; }
-      T await_resume()
-      {
-         if (std::holds_alternative<std::exception_ptr>(handle.promise().value))
-            std::rethrow_exception(std::get<std::exception_ptr>(handle.promise().value));
-         return handle.promise().RetrieveValue();
-      }
+      T await_resume() { return handle.promise().Result(); }
    };
-   return Awaiter{m_handle};
+   return Awaiter{handle};
 }
 
+template <TaskResult T, Executor E>
+auto TaskHandle<T, E>::Prepare(E executor, const bool * parentCanceled) -> handle_type
+{
+   m_handle.promise().Executor() = std::move(executor);
+   m_handle.promise().SetParentCanceled(parentCanceled);
+   return m_handle;
+}
+
+namespace internal {
+
+// Starts a group of tasks like TaskHandle::Run() does, but with one ExecuteBatch() call. All of
+// them are prepared before the first one runs, which might relocate or destroy the TaskHandles.
+struct TaskLauncher
+{
+   template <TaskResult T, Executor E, std::size_t N>
+   static void RunAll(std::span<TaskHandle<T, E>, N> tasks,
+                      E executor,
+                      const bool * parentCanceled = nullptr)
+   {
+      if constexpr (N == std::dynamic_extent) {
+         std::vector<stdcr::coroutine_handle<>> handles;
+         handles.reserve(tasks.size());
+         for (auto & task : tasks)
+            handles.push_back(task.Prepare(executor, parentCanceled));
+         ExecuteBatch(executor, handles);
+      } else {
+         std::array<stdcr::coroutine_handle<>, N> handles;
+         for (std::size_t i = 0; i < N; ++i)
+            handles[i] = tasks[i].Prepare(executor, parentCanceled);
+         ExecuteBatch(executor, handles);
+      }
+   }
+
+   // Frees a task that was never run, which dropping its TaskHandle would only mark as canceled
+   template <TaskResult T, Executor E>
+   static void Discard(TaskHandle<T, E> && task) noexcept
+   {
+      if (auto handle = std::exchange(task.m_handle, nullptr))
+         handle.destroy();
+   }
+};
+
+} // namespace internal
+
 template <TaskResult T, Executor E>
 void TaskHandle<T, E>::EnsureNoException()
 {
    if (!m_handle || !m_handle.done())
       return;
 
-   if (const auto * exptr = std::get_if<std::exception_ptr>(&m_handle.promise().value)) {
+   if (const auto * exptr = std::get_if<std::exception_ptr>(&m_handle.promise().Value())) {
       std::exception_ptr copy = *exptr;
-      m_handle.promise().value.template emplace<std::monostate>();
+      m_handle.promise().Value().template emplace<std::monostate>();
       std::rethrow_exception(copy);
    }
 }
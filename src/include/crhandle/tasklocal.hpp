@@ -0,0 +1,156 @@
+#ifndef TASKLOCAL_HPP
+#define TASKLOCAL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace cr {
+
+namespace internal {
+
+// Immutable snapshot of the task-local values visible to a task, indexed by TaskLocal id
+struct TaskLocals
+{
+   std::vector<const void *> values;
+
+   const void * Find(std::size_t id) const noexcept
+   {
+      return id < values.size() ? values[id] : nullptr;
+   }
+};
+
+// What the children of a task inside a TaskLocalBinding point to instead of a bare cancelation
+// flag. Promises hold no task-locals of their own, so tasks that use none pay nothing for them.
+struct TaskContext
+{
+   const bool * canceled; // flag of the cancelation root, unless taken from enclosing
+   const TaskLocals * locals;
+   const TaskContext * enclosing; // context of the task that made this one, if it had one
+
+   // Looked up every time, as the root of the outermost context may change, see WithDeadline()
+   const bool * Canceled() const noexcept
+   {
+      const TaskContext * context = this;
+      while (context->enclosing)
+         context = context->enclosing;
+      return context->canceled;
+   }
+};
+
+inline std::size_t NextTaskLocalId() noexcept
+{
+   static std::atomic<std::size_t> s_nextId{0};
+   return s_nextId.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+struct TaskLocalGet
+{
+   std::size_t id;
+};
+
+template <typename T>
+struct TaskLocalBind
+{
+   std::size_t id;
+   T value;
+};
+
+} // namespace internal
+
+// Keeps a task-local value bound for the current task and the children it starts from now on, and
+// restores the previous binding when destroyed. Must not outlive the task that created it.
+template <typename T>
+class [[nodiscard]] TaskLocalBinding
+{
+public:
+   template <typename P>
+   TaskLocalBinding(P & promise, internal::TaskLocalBind<T> && bind)
+      : m_node(
+           std::make_unique<Node>(promise.CancelationFlag(), promise.Context(), std::move(bind)))
+      , m_hasContext(&promise.hasContext)
+      , m_parentLink(&promise.parentLink)
+      , m_hadContext(promise.hasContext)
+      , m_previousLink(promise.parentLink)
+   {
+      promise.EnterContext(m_node->context);
+   }
+
+   TaskLocalBinding(TaskLocalBinding && other) noexcept
+      : m_node(std::move(other.m_node))
+      , m_hasContext(std::exchange(other.m_hasContext, nullptr))
+      , m_parentLink(other.m_parentLink)
+      , m_hadContext(other.m_hadContext)
+      , m_previousLink(other.m_previousLink)
+   {}
+
+   TaskLocalBinding & operator=(TaskLocalBinding &&) = delete;
+
+   ~TaskLocalBinding()
+   {
+      if (m_hasContext) {
+         *m_hasContext = m_hadContext;
+         *m_parentLink = m_previousLink;
+      }
+   }
+
+private:
+   struct Node : internal::TaskLocals
+   {
+      T value;
+      internal::TaskContext context;
+
+      Node(const bool & canceled,
+           const internal::TaskContext * enclosing,
+           internal::TaskLocalBind<T> && bind)
+         : internal::TaskLocals{enclosing && enclosing->locals ? enclosing->locals->values
+                                                               : std::vector<const void *>{}}
+         , value(std::move(bind.value))
+         , context{enclosing ? nullptr : &canceled, this, enclosing}
+      {
+         if (values.size() <= bind.id)
+            values.resize(bind.id + 1, nullptr);
+         values[bind.id] = &value;
+      }
+   };
+
+   std::unique_ptr<Node> m_node;
+   bool * m_hasContext;
+   const void ** m_parentLink;
+   bool m_hadContext;
+   const void * m_previousLink;
+};
+
+// Key for a value that is visible to a task and all tasks nested in it via co_await, e.g. a
+// request id or a trace span. Keys are typically global constants:
+//
+//    inline const cr::TaskLocal<RequestId> g_requestId;
+//    auto binding = co_await g_requestId.Bind(id);
+//    const RequestId * current = co_await g_requestId.Get(); // nullptr if not bound
+//
+template <typename T>
+class TaskLocal
+{
+public:
+   TaskLocal() noexcept
+      : m_id(internal::NextTaskLocalId())
+   {}
+   TaskLocal(const TaskLocal &) = delete;
+   TaskLocal & operator=(const TaskLocal &) = delete;
+
+   [[nodiscard]] internal::TaskLocalGet<T> Get() const noexcept { return {m_id}; }
+   [[nodiscard]] internal::TaskLocalBind<T> Bind(T value) const
+   {
+      return {m_id, std::move(value)};
+   }
+
+private:
+   const std::size_t m_id;
+};
+
+} // namespace cr
+
+#endif
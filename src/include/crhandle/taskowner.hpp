@@ -3,6 +3,8 @@
 
 #include "crhandle/taskhandle.hpp"
 
+#include <cstddef>
+#include <span>
 #include <vector>
 
 namespace cr {
@@ -25,6 +27,19 @@ public:
       m_tasks.back().Run(m_executor);
    }
 
+   // Takes over all tasks and starts them with a single ExecuteBatch() call if E supports it
+   void StartRootTasks(std::span<TaskHandle<void, E>> tasks)
+   {
+      RethrowExceptions();
+      std::erase_if(m_tasks, [](const TaskHandle<void, E> & t) {
+         return !t;
+      });
+      const std::size_t first = m_tasks.size();
+      for (auto & task : tasks)
+         m_tasks.emplace_back(std::move(task));
+      internal::TaskLauncher::RunAll(std::span(m_tasks).subspan(first), m_executor);
+   }
+
    [[nodiscard]] auto StartNestedTask(TaskHandle<void, E> && task)
    {
       struct SuspenderStarter
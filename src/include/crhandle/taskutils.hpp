@@ -2,15 +2,24 @@
 #define TASKUTILS_HPP
 
 #include "crhandle/taskhandle.hpp"
+#include "crhandle/timerqueue.hpp"
 
 #include <array>
+#include <cassert>
+#include <exception>
 #include <optional>
+#include <span>
 #include <tuple>
 #include <type_traits>
 #include <variant>
 
 namespace cr {
 
+struct TimeoutException : std::exception
+{
+   const char * what() const noexcept override { return "Coroutine timed out"; }
+};
+
 namespace internal {
 
 template <typename P = void>
@@ -56,6 +65,119 @@ bool AllValuesSet(const std::tuple<std::optional<Ts>...> & t) noexcept
       t);
 }
 
+// Context of the tasks started by WithDeadline(), living in the frame that awaits them. Until
+// Detach(), they are canceled along with the task awaiting WithDeadline().
+struct DeadlineLink
+{
+   TaskContext context;
+   const bool * ownCanceled;
+
+   // Called before the task awaiting WithDeadline() may be gone, which is no longer looked at then
+   void Detach() noexcept
+   {
+      context.canceled = ownCanceled;
+      context.enclosing = nullptr;
+   }
+};
+
+// The frame the task given to WithDeadline() is awaited in. It outlives the task, so the context it
+// publishes to the WithDeadline() frame does too.
+template <TaskResult T, Executor E>
+TaskHandle<T, E> AwaitDeadlineTask(TaskHandle<T, E> task,
+                                   DeadlineLink link,
+                                   DeadlineLink *& published)
+{
+   using PromiseType = typename TaskHandle<T, E>::promise_type;
+   auto thisHandle = co_await CurrentHandleRetriever<PromiseType>{};
+   link.ownCanceled = &thisHandle.promise().CancelationFlag();
+   thisHandle.promise().EnterContext(link.context);
+   published = &link;
+   co_return co_await std::move(task);
+}
+
+// Awaits a running child task with a single armed timer living in the awaiting frame. On expiry the
+// child is canceled by dropping its handle and the awaiting coroutine is resumed on its executor.
+template <typename Clock, TaskResult T, Executor E, Awaiter ChildAwaiter>
+struct DeadlineAwaiter : TimerQueue<Clock>::Timer
+{
+   using TimerType = typename TimerQueue<Clock>::Timer;
+
+   TimerQueue<Clock> & timers;
+   typename Clock::time_point deadline;
+   TaskHandle<T, E> & task;
+   DeadlineLink *& link;
+   ChildAwaiter child;
+   E executor;
+   stdcr::coroutine_handle<> handle = nullptr;
+   bool expired = false;
+
+   DeadlineAwaiter(TimerQueue<Clock> & timers,
+                   typename Clock::time_point deadline,
+                   TaskHandle<T, E> & task,
+                   DeadlineLink *& link,
+                   ChildAwaiter child,
+                   E executor)
+      : TimerType(&Expire)
+      , timers(timers)
+      , deadline(deadline)
+      , task(task)
+      , link(link)
+      , child(std::move(child))
+      , executor(std::move(executor))
+   {}
+   DeadlineAwaiter(DeadlineAwaiter && other)
+      : DeadlineAwaiter(other.timers,
+                        other.deadline,
+                        other.task,
+                        other.link,
+                        std::move(other.child),
+                        std::move(other.executor))
+   {
+      assert(!other.Armed());
+   }
+
+   bool await_ready() { return child.await_ready(); }
+   void await_suspend(stdcr::coroutine_handle<> h)
+   {
+      handle = h;
+      child.await_suspend(h);
+      timers.Arm(*this, deadline);
+   }
+   T await_resume()
+   {
+      this->Disarm();
+      if (expired)
+         throw TimeoutException{};
+      return child.await_resume();
+   }
+
+   static void Expire(TimerType & timer)
+   {
+      auto & self = static_cast<DeadlineAwaiter &>(timer);
+      // a finished child has already scheduled the resumption of the awaiting coroutine
+      if (!self.task)
+         return;
+      self.expired = true;
+      // a task that hasn't started yet is canceled before it could publish its link
+      if (self.link)
+         self.link->Detach();
+      self.task = {};
+      self.executor.Execute(self.handle);
+   }
+};
+
+// Awaits a task that is its own cancelation root, e.g. one that may outlive the task starting it,
+// with the task-locals of the latter. The context lives in this frame, which outlives the task.
+template <TaskResult T, Executor E>
+TaskHandle<T, E> WithTaskLocals(TaskHandle<T, E> task, const TaskLocals * locals)
+{
+   using PromiseType = typename TaskHandle<T, E>::promise_type;
+   auto thisHandle = co_await CurrentHandleRetriever<PromiseType>{};
+   const TaskContext context{&thisHandle.promise().CancelationFlag(), locals, nullptr};
+   thisHandle.promise().EnterContext(context);
+   co_return co_await std::move(task);
+}
+
 } // namespace internal
 
 template <typename P = void>
@@ -77,11 +199,16 @@ struct AnyOfFn
    {
       std::optional<std::variant<NonVoid<Rs>...>> ret;
       stdcr::coroutine_handle<> continuation = nullptr;
+      const internal::TaskLocals * locals = nullptr;
 
       auto TaskWrapper = [&]<size_t I, typename R>(std::in_place_index_t<I> i,
                                                    TaskHandle<R, E> task) -> TaskHandle<void, E> {
-         if (ret.has_value())
+         if (ret.has_value()) {
+            internal::TaskLauncher::Discard(std::move(task));
             co_return;
+         }
+         if (locals)
+            task = internal::WithTaskLocals(std::move(task), locals);
 
          if constexpr (std::is_same_v<R, void>) {
             co_await std::move(task);
@@ -101,8 +228,9 @@ struct AnyOfFn
       auto thisHandle = co_await CurrentHandle<typename HandleType<E, Rs...>::promise_type>();
       const auto & thisPromise = thisHandle.promise();
 
-      for (auto & h : tasks)
-         h.Run(thisPromise.Executor());
+      // the wrappers are cancelation roots of their own, as the losers may outlive this frame
+      locals = thisPromise.Locals();
+      internal::TaskLauncher::RunAll(std::span(tasks), thisPromise.Executor());
 
       if (!ret.has_value()) {
          continuation = thisHandle;
@@ -120,22 +248,41 @@ struct AllOfFn
    template <Executor E, TaskResult... Rs>
    using HandleType = TaskHandle<std::tuple<NonVoid<Rs>...>, E>;
 
+   // The first exception thrown by any task cancels the other ones and is rethrown right away
    template <Executor E, TaskResult... Rs>
    HandleType<E, Rs...> operator()(TaskHandle<Rs, E>... ts) const
    {
       std::tuple<std::optional<NonVoid<Rs>>...> ret;
+      std::exception_ptr failure;
       stdcr::coroutine_handle<> continuation = nullptr;
+      const internal::TaskLocals * locals = nullptr;
 
       auto TaskWrapper = [&]<size_t I, typename R>(std::in_place_index_t<I>,
                                                    TaskHandle<R, E> task) -> TaskHandle<void, E> {
-         if constexpr (std::is_same_v<R, void>) {
-            co_await std::move(task);
-            std::get<I>(ret).emplace(NonVoid<void>{});
-         } else {
-            R tmp = co_await std::move(task);
-            std::get<I>(ret).emplace(std::move(tmp));
+         if (failure) {
+            internal::TaskLauncher::Discard(std::move(task));
+            co_return;
+         }
+         auto wrapperHandle = co_await CurrentHandle<typename TaskHandle<void, E>::promise_type>();
+         if (locals)
+            task = internal::WithTaskLocals(std::move(task), locals);
+         try {
+            if constexpr (std::is_same_v<R, void>) {
+               co_await std::move(task);
+               std::get<I>(ret).emplace(NonVoid<void>{});
+            } else {
+               R tmp = co_await std::move(task);
+               std::get<I>(ret).emplace(std::move(tmp));
+            }
+         }
+         catch (...) {
+            // a canceled wrapper might have outlived this frame
+            if (wrapperHandle.promise().IsCanceled())
+               throw;
+            if (!failure)
+               failure = std::current_exception();
          }
-         if (continuation && internal::AllValuesSet(ret))
+         if (continuation && (failure || internal::AllValuesSet(ret)))
             continuation.resume();
       };
 
@@ -146,20 +293,70 @@ struct AllOfFn
       auto thisHandle = co_await CurrentHandle<typename HandleType<E, Rs...>::promise_type>();
       const auto & thisPromise = thisHandle.promise();
 
-      for (auto & h : tasks)
-         h.Run(thisPromise.Executor());
+      // the wrappers are cancelation roots of their own, as they may outlive this frame on failure
+      locals = thisPromise.Locals();
+      internal::TaskLauncher::RunAll(std::span(tasks), thisPromise.Executor());
 
-      if (!internal::AllValuesSet(ret)) {
+      if (!failure && !internal::AllValuesSet(ret)) {
          continuation = thisHandle;
          co_await stdcr::suspend_always{};
       }
 
+      if (failure) {
+         for (auto & h : tasks)
+            h = {};
+         std::rethrow_exception(failure);
+      }
+
       co_return internal::ToNonOptional(std::move(ret));
    }
 };
 
 inline constexpr AllOfFn AllOf;
 
+// Throws TimeoutException if the task hasn't finished by the deadline, in which case the task is
+// canceled. Deadlines are checked when the timer queue's owner calls TimerQueue::FireExpired().
+struct WithDeadlineFn
+{
+   template <typename Clock, TaskResult T, Executor E>
+   TaskHandle<T, E> operator()(TimerQueue<Clock> & timers,
+                               TaskHandle<T, E> task,
+                               typename Clock::time_point deadline) const
+   {
+      auto thisHandle = co_await CurrentHandle<typename TaskHandle<T, E>::promise_type>();
+      const auto & thisPromise = thisHandle.promise();
+
+      // The task may outlive this frame after expiring, so it is its own cancelation root. It is
+      // still canceled along with this one through a context that is detached on expiry.
+      const internal::TaskContext * enclosing = thisPromise.Context();
+      internal::DeadlineLink * link = nullptr;
+      task = internal::AwaitDeadlineTask(
+         std::move(task),
+         internal::DeadlineLink{
+            {enclosing ? nullptr : &thisPromise.CancelationFlag(), thisPromise.Locals(), enclosing},
+            nullptr},
+         link);
+      auto child = task.Run(thisPromise.Executor());
+      co_return co_await internal::DeadlineAwaiter<Clock, T, E, decltype(child)>(
+         timers, deadline, task, link, std::move(child), thisPromise.Executor());
+   }
+};
+
+inline constexpr WithDeadlineFn WithDeadline;
+
+struct WithTimeoutFn
+{
+   template <typename Clock, TaskResult T, Executor E>
+   TaskHandle<T, E> operator()(TimerQueue<Clock> & timers,
+                               TaskHandle<T, E> task,
+                               typename Clock::duration timeout) const
+   {
+      return WithDeadline(timers, std::move(task), Clock::now() + timeout);
+   }
+};
+
+inline constexpr WithTimeoutFn WithTimeout;
+
 } // namespace cr
 
 #endif
@@ -0,0 +1,119 @@
+#ifndef TIMERQUEUE_HPP
+#define TIMERQUEUE_HPP
+
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
+namespace cr {
+
+// Intrusive list of timers sorted by deadline and driven by the owner's event loop through
+// FireExpired(). Timers are inserted by scanning from the latest deadline, which is O(1) for the
+// common case of a fixed timeout, and are disarmed in O(1). Not thread safe: timers must be armed,
+// disarmed and fired on the same thread.
+template <typename Clock = std::chrono::steady_clock>
+class TimerQueue
+{
+public:
+   using TimePoint = typename Clock::time_point;
+
+   class Timer
+   {
+   public:
+      using Callback = void (*)(Timer &);
+
+      explicit Timer(Callback callback) noexcept
+         : m_callback(callback)
+      {}
+      Timer(const Timer &) = delete;
+      Timer & operator=(const Timer &) = delete;
+      ~Timer() { Disarm(); }
+
+      bool Armed() const noexcept { return m_queue != nullptr; }
+      TimePoint Deadline() const noexcept { return m_deadline; }
+
+      void Disarm() noexcept
+      {
+         if (m_queue)
+            m_queue->Unlink(*this);
+      }
+
+   private:
+      friend class TimerQueue;
+
+      Callback m_callback;
+      TimerQueue * m_queue = nullptr;
+      Timer * m_prev = nullptr;
+      Timer * m_next = nullptr;
+      TimePoint m_deadline{};
+   };
+
+   TimerQueue() = default;
+   TimerQueue(const TimerQueue &) = delete;
+   TimerQueue & operator=(const TimerQueue &) = delete;
+
+   // Timers still armed are disarmed without firing
+   ~TimerQueue()
+   {
+      while (m_head)
+         Unlink(*m_head);
+   }
+
+   // Timers with equal deadlines fire in the order they were armed
+   void Arm(Timer & timer, TimePoint deadline) noexcept
+   {
+      timer.Disarm();
+      timer.m_deadline = deadline;
+      timer.m_queue = this;
+
+      Timer * prev = m_tail;
+      while (prev && deadline < prev->m_deadline)
+         prev = prev->m_prev;
+
+      timer.m_prev = prev;
+      timer.m_next = prev ? prev->m_next : m_head;
+      (timer.m_next ? timer.m_next->m_prev : m_tail) = &timer;
+      (prev ? prev->m_next : m_head) = &timer;
+   }
+
+   // Invokes the callbacks of all timers with deadline <= now, returns how many fired. A timer is
+   // disarmed before its callback is invoked, so the callback may destroy or re-arm it.
+   std::size_t FireExpired(TimePoint now = Clock::now())
+   {
+      std::size_t fired = 0;
+      while (m_head && m_head->m_deadline <= now) {
+         Timer & timer = *m_head;
+         Unlink(timer);
+         timer.m_callback(timer);
+         ++fired;
+      }
+      return fired;
+   }
+
+   std::optional<TimePoint> NextDeadline() const noexcept
+   {
+      if (!m_head)
+         return std::nullopt;
+      return m_head->m_deadline;
+   }
+
+   bool Empty() const noexcept { return m_head == nullptr; }
+
+private:
+   void Unlink(Timer & timer) noexcept
+   {
+      assert(timer.m_queue == this);
+      (timer.m_prev ? timer.m_prev->m_next : m_head) = timer.m_next;
+      (timer.m_next ? timer.m_next->m_prev : m_tail) = timer.m_prev;
+      timer.m_prev = timer.m_next = nullptr;
+      timer.m_queue = nullptr;
+   }
+
+   Timer * m_head = nullptr;
+   Timer * m_tail = nullptr;
+};
+
+} // namespace cr
+
+#endif
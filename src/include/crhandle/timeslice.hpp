@@ -0,0 +1,37 @@
+#ifndef TIMESLICE_HPP
+#define TIMESLICE_HPP
+
+#include <chrono>
+
+namespace cr::internal {
+
+// Measures how long the work item currently run by a dispatcher has been running. A zero budget
+// disables time slicing and never reads the clock.
+class TimeSlice
+{
+public:
+   using Clock = std::chrono::steady_clock;
+
+   explicit TimeSlice(std::chrono::microseconds budget) noexcept
+      : m_budget(budget)
+   {}
+
+   void Start() noexcept
+   {
+      if (m_budget.count() > 0)
+         m_start = Clock::now();
+   }
+
+   bool Exceeded() const noexcept
+   {
+      return m_budget.count() > 0 && Clock::now() - m_start > m_budget;
+   }
+
+private:
+   const std::chrono::microseconds m_budget;
+   Clock::time_point m_start{};
+};
+
+} // namespace cr::internal
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef TRAMPOLINE_HPP
+#define TRAMPOLINE_HPP
+
+#include "crhandle/uniquefunction.hpp"
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <utility>
+
+namespace cr {
+
+namespace internal {
+
+struct TrampolineState
+{
+   std::deque<UniqueFunction> pending;
+   bool running = false;
+};
+
+inline thread_local TrampolineState t_trampoline;
+
+} // namespace internal
+
+// Inline executor that flattens nested work into a loop. Execute() called outside of any task runs
+// the task right away and then everything it has posted, in FIFO order. Execute() called from a
+// running task only queues the work, so long chains of synchronous resumptions, e.g. a consumer
+// sending to its own Unichannel, run in constant stack space. RunningInThisThread() is true inside
+// a task, thus starting a child or resuming a parent is dispatched in place up to MaxDispatchDepth
+// levels deep and only goes through the queue beyond that. The queue is always drained before the
+// outermost Execute() returns, even if tasks throw; it then rethrows the first exception.
+struct TrampolineExecutor
+{
+   template <typename F>
+   void Execute(F && f) const
+   {
+      auto & state = internal::t_trampoline;
+      if (state.running) {
+         state.pending.emplace_back(std::forward<F>(f));
+         return;
+      }
+
+      struct RunningGuard
+      {
+         bool & running;
+         explicit RunningGuard(bool & running) noexcept
+            : running(running)
+         {
+            running = true;
+         }
+         ~RunningGuard() { running = false; }
+      } guard(state.running);
+
+      std::exception_ptr failure;
+      try {
+         std::invoke(std::forward<F>(f));
+      }
+      catch (...) {
+         failure = std::current_exception();
+      }
+      while (!state.pending.empty()) {
+         internal::UniqueFunction next = std::move(state.pending.front());
+         state.pending.pop_front();
+         try {
+            next();
+         }
+         catch (...) {
+            if (!failure)
+               failure = std::current_exception();
+         }
+      }
+      if (failure)
+         std::rethrow_exception(failure);
+   }
+
+   bool RunningInThisThread() const noexcept { return internal::t_trampoline.running; }
+
+   bool operator==(const TrampolineExecutor &) const = default;
+};
+
+} // namespace cr
+
+#endif
@@ -3,12 +3,49 @@
 
 #include "crhandle/taskhandle.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace cr {
 
+namespace internal {
+
+// Shared by all registrations of one Select. The first channel to claim it gets to resume the
+// selecting coroutine. The registrations left on the other channels are skipped by them until
+// the selector erases them.
+struct SelectState
+{
+   static constexpr std::size_t NoWinner = std::numeric_limits<std::size_t>::max();
+
+   std::atomic<std::size_t> winner = NoWinner;
+
+   bool TryClaim(std::size_t index) noexcept
+   {
+      std::size_t expected = NoWinner;
+      return winner.compare_exchange_strong(expected, index);
+   }
+};
+
+template <Executor E, typename... Ts>
+class SelectAwaiter;
+
+} // namespace internal
+
 template <typename T, Executor E = InlineExecutor>
 class Unichannel
    : public std::enable_shared_from_this<Unichannel<T, E>>
@@ -25,12 +62,33 @@ public:
    ~Unichannel()
    {
       assert(m_consumers.empty() || m_items.empty());
-      for (auto handle : m_consumers)
-         handle.resume();
+      while (!m_consumers.empty()) {
+         Consumer consumer = m_consumers.front();
+         m_consumers.pop_front();
+         if (consumer.Claim())
+            consumer.handle.resume();
+      }
    }
 
+   // Throws CanceledException once the channel has been closed and drained, or destroyed
    cr::TaskHandle<T, E> Next() { co_return co_await SubmitConsumer(); }
 
+   // Like Next(), but returns std::nullopt at the end of the stream instead of throwing
+   cr::TaskHandle<std::optional<T>, E> Receive() { co_return co_await SubmitReceiver(); }
+
+   // Moves up to max items that are already queued into out without waiting and returns how many.
+   // Like the rest of the channel state it may only be touched on the channel's executor, e.g. by
+   // a consumer right after Receive() has returned.
+   std::size_t TakeReady(std::vector<T> & out, std::size_t max)
+   {
+      const std::size_t count = std::min(max, m_items.size());
+      out.insert(out.end(),
+                 std::make_move_iterator(m_items.begin()),
+                 std::make_move_iterator(m_items.begin() + count));
+      m_items.erase(m_items.begin(), m_items.begin() + count);
+      return count;
+   }
+
    class Producer : private E
    {
    public:
@@ -39,72 +97,326 @@ public:
          , m_channel(channel)
       {}
 
-      bool Send(T && item)
+      bool Send(T && item) { return Emplace(std::move(item)); }
+
+      // Constructs the item from args directly in the channel's queue
+      template <typename... Args>
+      bool Emplace(Args &&... args)
+      {
+         auto channel = Accept();
+         if (!channel)
+            return false;
+
+         if constexpr (internal::IsInlineExecutor<E>) {
+            channel->SubmitItem(std::forward<Args>(args)...);
+         } else {
+            auto packed = std::tuple<std::decay_t<Args>...>(std::forward<Args>(args)...);
+            E::Execute([channel = std::move(channel), packed = std::move(packed)]() mutable {
+               std::apply([&](auto &... a) { channel->SubmitItem(std::move(a)...); }, packed);
+            });
+         }
+         return true;
+      }
+
+      // Moves all items into the channel with a single closure posted to its executor
+      bool SendBatch(std::span<T> items)
+      {
+         if (items.empty())
+            return Lock() != nullptr;
+         auto channel = Accept();
+         if (!channel)
+            return false;
+
+         if constexpr (internal::IsInlineExecutor<E>) {
+            channel->SubmitBatch(items);
+         } else {
+            PostBatch(std::move(channel),
+                      std::vector<T>(std::make_move_iterator(items.begin()),
+                                     std::make_move_iterator(items.end())));
+         }
+         return true;
+      }
+
+      // Copies the items of any range, wrap the iterators in std::make_move_iterator to move them
+      template <std::input_iterator It, std::sentinel_for<It> S>
+         requires std::constructible_from<T, std::iter_reference_t<It>>
+      bool SendBatch(It first, S last)
+      {
+         std::vector<T> batch;
+         for (; first != last; ++first)
+            batch.emplace_back(*first);
+         if (batch.empty())
+            return Lock() != nullptr;
+         auto channel = Accept();
+         if (!channel)
+            return false;
+         PostBatch(std::move(channel), std::move(batch));
+         return true;
+      }
+
+      // Ends the stream for all producers of the channel. Items sent before are still delivered,
+      // later sends fail. Returns false if the channel is already closed or dead.
+      bool Close()
       {
          auto channel = m_channel.lock();
          if (!channel)
             return false;
+         const std::uint64_t prev =
+            channel->m_sends.fetch_or(ClosedBit, std::memory_order_acq_rel);
+         if (prev & ClosedBit)
+            return false;
 
-         E::Execute([channel = std::move(channel), item = std::move(item)]() mutable {
-            channel->SubmitItem(std::move(item));
-         });
+         const std::uint64_t accepted = prev / SendUnit;
+         E::Execute([channel = std::move(channel), accepted] { channel->SubmitClose(accepted); });
          return true;
       }
 
    private:
+      // The channel if it is alive and open
+      std::shared_ptr<ChT> Lock() const
+      {
+         auto channel = m_channel.lock();
+         if (channel && (channel->m_sends.load(std::memory_order_acquire) & ClosedBit))
+            channel.reset();
+         return channel;
+      }
+
+      // Like Lock(), but also counts a send the channel has to deliver before it closes. The
+      // check and the count are one atomic step, so a Close() either sees the send or fails it.
+      std::shared_ptr<ChT> Accept() const
+      {
+         auto channel = m_channel.lock();
+         if (!channel)
+            return channel;
+         std::uint64_t sends = channel->m_sends.load(std::memory_order_relaxed);
+         do {
+            if (sends & ClosedBit)
+               return nullptr;
+         } while (!channel->m_sends.compare_exchange_weak(
+            sends, sends + SendUnit, std::memory_order_acq_rel, std::memory_order_relaxed));
+         return channel;
+      }
+
+      void PostBatch(std::shared_ptr<ChT> && channel, std::vector<T> && batch)
+      {
+         E::Execute([channel = std::move(channel), batch = std::move(batch)]() mutable {
+            channel->SubmitBatch(std::span<T>(batch));
+         });
+      }
+
       std::weak_ptr<ChT> m_channel;
    };
 
 
 private:
+   template <Executor, typename...>
+   friend class internal::SelectAwaiter;
+
+   struct Consumer
+   {
+      stdcr::coroutine_handle<> handle;
+      internal::SelectState * select = nullptr;
+      std::size_t index = 0;
+
+      bool Claim() const noexcept { return !select || select->TryClaim(index); }
+   };
+
    explicit Unichannel(E executor)
       : E{executor}
    {}
 
+   T PopItem()
+   {
+      if (m_items.empty())
+         throw CanceledException{};
+
+      T temp = std::move(m_items.front());
+      m_items.pop_front();
+      return temp;
+   }
+
    auto SubmitConsumer()
    {
       struct Awaiter
       {
          Unichannel & owner;
 
-         bool await_ready() noexcept { return !owner.m_items.empty(); }
+         bool await_ready() noexcept { return !owner.m_items.empty() || owner.m_closed; }
          void await_suspend(stdcr::coroutine_handle<> handle)
          {
             assert(owner.m_items.empty());
-            owner.m_consumers.emplace_back(handle);
+            owner.m_consumers.emplace_back(Consumer{handle});
          }
-         T await_resume()
-         {
-            if (owner.m_items.empty())
-               throw CanceledException{};
+         T await_resume() { return owner.PopItem(); }
+      };
+      return Awaiter{*this};
+   }
 
-            T temp = std::move(owner.m_items.front());
-            owner.m_items.pop_front();
-            return temp;
+   auto SubmitReceiver()
+   {
+      struct Awaiter : decltype(std::declval<Unichannel &>().SubmitConsumer())
+      {
+         std::optional<T> await_resume()
+         {
+            if (this->owner.m_items.empty())
+               return std::nullopt;
+            return this->owner.PopItem();
          }
       };
-      return Awaiter{*this};
+      return Awaiter{SubmitConsumer()};
    }
 
-   void SubmitItem(T && item)
+   // Every submission was accepted before the channel closed, so none of them is dropped
+   template <typename... Args>
+   void SubmitItem(Args &&... args)
    {
-      m_items.emplace_back(std::move(item));
+      assert(!m_closed);
+      assert(m_consumers.empty() || m_items.empty());
+      m_items.emplace_back(std::forward<Args>(args)...);
+      ++m_submitted;
+      ResumeConsumers();
+   }
 
-      if (m_consumers.empty())
-         return;
+   void SubmitBatch(std::span<T> items)
+   {
+      assert(!m_closed);
+      assert(m_consumers.empty() || m_items.empty());
+      m_items.insert(m_items.end(),
+                     std::make_move_iterator(items.begin()),
+                     std::make_move_iterator(items.end()));
+      ++m_submitted;
+      ResumeConsumers();
+   }
+
+   // A send accepted before Close() may still be on its way on a multi-threaded executor, so the
+   // stream ends only once all of them have arrived
+   void SubmitClose(std::uint64_t accepted)
+   {
+      m_closeAfter = accepted;
+      ResumeConsumers();
+   }
 
-      assert(m_items.size() == 1);
-      while (!m_items.empty() && !m_consumers.empty()) {
-         auto handle = m_consumers.front();
+   // Waiting consumers imply an empty queue, so all of them see the end of the stream
+   void ResumeConsumers()
+   {
+      if (!m_closed && m_submitted == m_closeAfter)
+         m_closed = true;
+      while ((!m_items.empty() || m_closed) && !m_consumers.empty()) {
+         Consumer consumer = m_consumers.front();
          m_consumers.pop_front();
-         handle.resume();
+         if (consumer.Claim())
+            consumer.handle.resume();
       }
    }
 
-   std::deque<stdcr::coroutine_handle<>> m_consumers;
+   // Sends accepted by producers, counted in SendUnits, and whether Close() has been called
+   static constexpr std::uint64_t ClosedBit = 1;
+   static constexpr std::uint64_t SendUnit = 2;
+
+   std::deque<Consumer> m_consumers;
    std::deque<T> m_items;
+   bool m_closed = false;
+   std::uint64_t m_submitted = 0;
+   std::uint64_t m_closeAfter = std::numeric_limits<std::uint64_t>::max();
+   std::atomic<std::uint64_t> m_sends = 0;
 };
 
+namespace internal {
+
+template <Executor E, typename... Ts>
+class SelectAwaiter
+{
+public:
+   explicit SelectAwaiter(Unichannel<Ts, E> &... channels) noexcept
+      : m_channels(&channels...)
+   {
+      assert(OnOneExecutor(channels...));
+   }
+   SelectAwaiter(SelectAwaiter && other) noexcept
+      : m_channels(other.m_channels)
+   {
+      assert(!other.m_registered);
+   }
+   ~SelectAwaiter() { Deregister(Indices{}); }
+
+   bool await_ready() noexcept { return ClaimReady(Indices{}); }
+   void await_suspend(stdcr::coroutine_handle<> handle) { Register(handle, Indices{}); }
+   std::variant<Ts...> await_resume() { return PopFromWinner(); }
+
+private:
+   using Indices = std::index_sequence_for<Ts...>;
+
+   // Executors that can't be compared are trusted to be the same one
+   template <typename T, typename... Us>
+   static bool OnOneExecutor(const Unichannel<T, E> & first, const Unichannel<Us, E> &... rest)
+   {
+      if constexpr (std::equality_comparable<E>)
+         return (... && (static_cast<const E &>(rest) == static_cast<const E &>(first)));
+      else
+         return true;
+   }
+
+   template <size_t... Is>
+   bool ClaimReady(std::index_sequence<Is...>) noexcept
+   {
+      auto Ready = [](const auto * channel) {
+         return !channel->m_items.empty() || channel->m_closed;
+      };
+      return (... || (Ready(std::get<Is>(m_channels)) && m_state.TryClaim(Is)));
+   }
+
+   template <size_t... Is>
+   void Register(stdcr::coroutine_handle<> handle, std::index_sequence<Is...>)
+   {
+      m_registered = true;
+      (..., std::get<Is>(m_channels)->m_consumers.push_back({handle, &m_state, Is}));
+   }
+
+   // The winning channel has already popped its registration
+   template <size_t... Is>
+   void Deregister(std::index_sequence<Is...>) noexcept
+   {
+      if (!m_registered)
+         return;
+      const std::size_t winner = m_state.winner.load();
+      auto Erase = [this](auto & consumers) {
+         std::erase_if(consumers, [this](const auto & c) {
+            return c.select == &m_state;
+         });
+      };
+      (..., (Is != winner ? Erase(std::get<Is>(m_channels)->m_consumers) : void()));
+   }
+
+   template <size_t I = 0>
+   std::variant<Ts...> PopFromWinner()
+   {
+      if constexpr (I + 1 < sizeof...(Ts)) {
+         if (m_state.winner.load() != I)
+            return PopFromWinner<I + 1>();
+      }
+      return std::variant<Ts...>(std::in_place_index<I>, std::get<I>(m_channels)->PopItem());
+   }
+
+   std::tuple<Unichannel<Ts, E> *...> m_channels;
+   SelectState m_state;
+   bool m_registered = false;
+};
+
+} // namespace internal
+
+// Waits until any of the channels has an item and takes exactly one item from it, the other
+// channels are left intact. Ready channels are preferred in the order they are passed. Throws
+// CanceledException if the winning channel is closed and drained, or dies.
+// The selector adds and erases its registrations in the consumer queues of all channels directly,
+// so the channels must share one executor instance that runs one task at a time, and the selecting
+// coroutine must run on it.
+template <Executor E, typename... Ts>
+cr::Awaiter auto Select(Unichannel<Ts, E> &... channels)
+{
+   static_assert(sizeof...(Ts) > 0);
+   return internal::SelectAwaiter<E, Ts...>{channels...};
+}
+
 } // namespace cr
 
 #endif
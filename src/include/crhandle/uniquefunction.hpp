@@ -0,0 +1,129 @@
+#ifndef UNIQUEFUNCTION_HPP
+#define UNIQUEFUNCTION_HPP
+
+#include "crhandle/coroutine.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cr::internal {
+
+// Move-only type-erased void() callable for executor queues. Callables up to the size of a few
+// pointers, such as coroutine handles and lambdas capturing a shared_ptr, are stored in place.
+class UniqueFunction
+{
+public:
+   static constexpr std::size_t InlineSize = 3 * sizeof(void *);
+
+   UniqueFunction() noexcept = default;
+
+   template <typename F>
+      requires(!std::is_same_v<std::remove_cvref_t<F>, UniqueFunction> &&
+               std::is_invocable_v<std::remove_cvref_t<F> &>)
+   UniqueFunction(F && f)
+   {
+      using Fn = std::remove_cvref_t<F>;
+      if constexpr (StoredInPlace<Fn>) {
+         ::new (m_storage) Fn(std::forward<F>(f));
+      } else {
+         *reinterpret_cast<Fn **>(m_storage) = new Fn(std::forward<F>(f));
+      }
+      m_ops = &s_ops<Fn>;
+   }
+
+   UniqueFunction(UniqueFunction && other) noexcept
+      : m_ops(std::exchange(other.m_ops, nullptr))
+   {
+      if (m_ops)
+         m_ops->relocate(other.m_storage, m_storage);
+   }
+
+   UniqueFunction & operator=(UniqueFunction && other) noexcept
+   {
+      if (this != &other) {
+         Reset();
+         m_ops = std::exchange(other.m_ops, nullptr);
+         if (m_ops)
+            m_ops->relocate(other.m_storage, m_storage);
+      }
+      return *this;
+   }
+
+   ~UniqueFunction() { Reset(); }
+
+   explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+   void operator()() { m_ops->invoke(m_storage); }
+
+private:
+   struct Ops
+   {
+      void (*invoke)(void *);
+      void (*relocate)(void * from, void * to) noexcept;
+      void (*destroy)(void *) noexcept;
+   };
+
+   template <typename Fn>
+   static constexpr bool StoredInPlace = sizeof(Fn) <= InlineSize &&
+                                         alignof(Fn) <= alignof(std::max_align_t) &&
+                                         std::is_nothrow_move_constructible_v<Fn>;
+
+   template <typename Fn>
+   static Fn & Get(void * storage) noexcept
+   {
+      if constexpr (StoredInPlace<Fn>)
+         return *std::launder(reinterpret_cast<Fn *>(storage));
+      else
+         return **reinterpret_cast<Fn **>(storage);
+   }
+
+   template <typename Fn>
+   static constexpr Ops s_ops{
+      [](void * storage) {
+         std::invoke(Get<Fn>(storage));
+      },
+      [](void * from, void * to) noexcept {
+         if constexpr (StoredInPlace<Fn>) {
+            ::new (to) Fn(std::move(Get<Fn>(from)));
+            Get<Fn>(from).~Fn();
+         } else {
+            *reinterpret_cast<Fn **>(to) = *reinterpret_cast<Fn **>(from);
+         }
+      },
+      [](void * storage) noexcept {
+         if constexpr (StoredInPlace<Fn>)
+            Get<Fn>(storage).~Fn();
+         else
+            delete &Get<Fn>(storage);
+      },
+   };
+
+   void Reset() noexcept
+   {
+      if (m_ops)
+         std::exchange(m_ops, nullptr)->destroy(m_storage);
+   }
+
+   alignas(std::max_align_t) unsigned char m_storage[InlineSize];
+   const Ops * m_ops = nullptr;
+};
+
+// Resumes h through the executor of the task it belongs to, or inline if it has none
+template <typename P>
+UniqueFunction MakeResumer(stdcr::coroutine_handle<P> h)
+{
+   if constexpr (requires { h.promise().Executor(); }) {
+      return [executor = h.promise().Executor(), h]() mutable {
+         executor.Execute(h);
+      };
+   } else {
+      return [h] { h.resume(); };
+   }
+}
+
+} // namespace cr::internal
+
+#endif
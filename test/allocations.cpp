@@ -0,0 +1,48 @@
+#include "allocations.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local std::size_t t_allocationCount = 0;
+
+} // namespace
+
+std::size_t AllocationCount() noexcept
+{
+   return t_allocationCount;
+}
+
+void * operator new(std::size_t size)
+{
+   ++t_allocationCount;
+   if (void * p = std::malloc(size ? size : 1))
+      return p;
+   throw std::bad_alloc{};
+}
+
+void * operator new[](std::size_t size)
+{
+   return ::operator new(size);
+}
+
+void operator delete(void * p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+   std::free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept
+{
+   std::free(p);
+}
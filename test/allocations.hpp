@@ -0,0 +1,9 @@
+#ifndef TEST_ALLOCATIONS_HPP
+#define TEST_ALLOCATIONS_HPP
+
+#include <cstddef>
+
+// Number of calls to the global operator new made by the calling thread
+std::size_t AllocationCount() noexcept;
+
+#endif
@@ -1,9 +1,13 @@
 #ifndef TEST_MANUALDISPATCHER_HPP
 #define TEST_MANUALDISPATCHER_HPP
 
+#include "crhandle/coroutine.hpp"
+
 #include <cassert>
+#include <cstddef>
 #include <deque>
 #include <functional>
+#include <span>
 #include <utility>
 
 template <typename F>
@@ -43,6 +47,15 @@ struct ManualDispatcher
          assert(master);
          master->queue.push_back(AlwaysCopyable(std::move(task)));
       }
+
+      void ExecuteBatch(std::span<stdcr::coroutine_handle<>> handles)
+      {
+         assert(master);
+         ++master->batches;
+         master->queue.insert(master->queue.end(), handles.begin(), handles.end());
+      }
+
+      bool operator==(const Executor &) const = default;
    };
 
    Executor GetExecutor() { return Executor{this}; }
@@ -64,6 +77,7 @@ struct ManualDispatcher
    }
 
    std::deque<Task> queue;
+   std::size_t batches = 0;
 };
 
 #endif
@@ -0,0 +1,320 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/actor.hpp"
+#include "crhandle/strand.hpp"
+#include "crhandle/taskhandle.hpp"
+#include "dispatcher.hpp"
+#include "threadpool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+
+struct Add
+{
+   int value;
+};
+
+struct Get
+{
+   cr::Reply<int> reply;
+};
+
+using CounterMsg = std::variant<Add, Get>;
+
+// Handler of an actor owning a plain int, answers Get with the sum of all Adds before it
+struct Counter
+{
+   std::shared_ptr<int> sum = std::make_shared<int>(0);
+
+   void operator()(CounterMsg && msg)
+   {
+      if (auto * add = std::get_if<Add>(&msg))
+         *sum += add->value;
+      else
+         std::get<Get>(msg).reply.Send(*sum);
+   }
+};
+
+auto MakeGet()
+{
+   return [](cr::Reply<int> reply) {
+      return CounterMsg{Get{std::move(reply)}};
+   };
+}
+
+struct ActorFixture : public ::testing::Test
+{
+   using StepwiseActor = cr::Actor<CounterMsg, ManualDispatcher::Executor>;
+   using StepwiseTask = cr::TaskHandle<void, ManualDispatcher::Executor>;
+
+   ManualDispatcher dispatcher;
+};
+
+TEST_F(ActorFixture, actor_handles_messages_in_order_on_inline_executor)
+{
+   std::vector<int> handled;
+   cr::Actor<int> actor([&handled](int msg) { handled.push_back(msg); });
+
+   EXPECT_TRUE(actor.Tell(1));
+   EXPECT_TRUE(actor.Tell(2));
+   EXPECT_TRUE(actor.Tell(3));
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), handled);
+   EXPECT_EQ(3u, actor.Stats().processed);
+   EXPECT_EQ(0u, actor.Stats().size);
+   EXPECT_TRUE(actor.Running());
+
+   actor.Stop();
+   EXPECT_FALSE(actor.Running());
+   EXPECT_FALSE(actor.Tell(4));
+   EXPECT_EQ(3u, handled.size());
+}
+
+TEST_F(ActorFixture, actor_handles_queued_messages_in_one_wakeup)
+{
+   std::vector<int> handled;
+   cr::Actor<int, ManualDispatcher::Executor> actor(dispatcher.GetExecutor(),
+                                                    [&handled](int msg) {
+                                                       handled.push_back(msg);
+                                                    });
+   dispatcher.ProcessAll();
+
+   for (int i = 0; i < 5; ++i)
+      actor.Tell(i);
+   EXPECT_EQ(5u, dispatcher.queue.size());
+
+   // delivering the messages wakes the loop once, which then takes all of them
+   for (int i = 0; i < 5; ++i)
+      EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_TRUE(handled.empty());
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ((std::vector<int>{0, 1, 2, 3, 4}), handled);
+
+   actor.Stop();
+   dispatcher.ProcessAll();
+   EXPECT_FALSE(actor.Running());
+}
+
+TEST_F(ActorFixture, actor_reports_mailbox_size)
+{
+   StepwiseActor actor(dispatcher.GetExecutor(), Counter{});
+
+   actor.Tell(Add{1});
+   actor.Tell(Add{2});
+   actor.Tell(Add{3});
+   EXPECT_EQ(3u, actor.Stats().size);
+   EXPECT_EQ(3u, actor.Stats().maxSize);
+   EXPECT_EQ(0u, actor.Stats().processed);
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(0u, actor.Stats().size);
+   EXPECT_EQ(3u, actor.Stats().maxSize);
+   EXPECT_EQ(3u, actor.Stats().processed);
+
+   actor.Tell(Add{4});
+   dispatcher.ProcessAll();
+   EXPECT_EQ(3u, actor.Stats().maxSize);
+   EXPECT_EQ(4u, actor.Stats().processed);
+
+   actor.Stop();
+   dispatcher.ProcessAll();
+}
+
+TEST_F(ActorFixture, ask_resumes_asker_with_reply)
+{
+   Counter counter;
+   StepwiseActor actor(dispatcher.GetExecutor(), counter);
+   int result = 0;
+
+   auto asker = [](StepwiseActor & actor, int & result) -> StepwiseTask {
+      actor.Tell(Add{20});
+      actor.Tell(Add{22});
+      result = co_await actor.Ask<int>(MakeGet());
+   }(actor, result);
+   asker.Run(dispatcher.GetExecutor());
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(42, result);
+   EXPECT_EQ(42, *counter.sum);
+   EXPECT_FALSE(asker);
+   EXPECT_NO_THROW(asker.EnsureNoException());
+
+   actor.Stop();
+   dispatcher.ProcessAll();
+}
+
+TEST_F(ActorFixture, ask_answered_inline_does_not_suspend)
+{
+   cr::Actor<CounterMsg> actor{Counter{}};
+   int result = 0;
+
+   auto asker = [](cr::Actor<CounterMsg> & actor, int & result) -> cr::TaskHandle<void> {
+      actor.Tell(Add{7});
+      result = co_await actor.Ask<int>(MakeGet());
+   }(actor, result);
+   asker.Run();
+
+   EXPECT_EQ(7, result);
+   EXPECT_FALSE(asker);
+}
+
+TEST_F(ActorFixture, ask_is_canceled_when_reply_is_dropped_or_mailbox_closed)
+{
+   using Msg = cr::Reply<int>;
+   cr::Actor<Msg, ManualDispatcher::Executor> actor(dispatcher.GetExecutor(), [](Msg) {});
+   int canceled = 0;
+
+   auto Asker = [](cr::Actor<Msg, ManualDispatcher::Executor> & actor,
+                   int & canceled) -> StepwiseTask {
+      try {
+         co_await actor.Ask<int>([](cr::Reply<int> reply) { return reply; });
+      }
+      catch (const cr::CanceledException &) {
+         ++canceled;
+      }
+   };
+
+   auto dropped = Asker(actor, canceled);
+   dropped.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_EQ(1, canceled);
+   EXPECT_FALSE(dropped);
+
+   actor.Stop();
+   dispatcher.ProcessAll();
+   EXPECT_FALSE(actor.Running());
+
+   auto refused = Asker(actor, canceled);
+   refused.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_EQ(2, canceled);
+   EXPECT_FALSE(refused);
+   EXPECT_EQ(1u, actor.Stats().processed);
+}
+
+TEST_F(ActorFixture, actor_awaits_task_returned_by_handler_before_next_message)
+{
+   using Task = cr::TaskHandle<void>;
+   std::vector<int> events;
+   std::vector<stdcr::coroutine_handle<>> parked;
+
+   struct Park
+   {
+      std::vector<stdcr::coroutine_handle<>> & parked;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(stdcr::coroutine_handle<> h) { parked.push_back(h); }
+      void await_resume() const noexcept {}
+   };
+
+   cr::Actor<int> actor([&](int msg) -> Task {
+      events.push_back(msg);
+      co_await Park{parked};
+      events.push_back(-msg);
+   });
+
+   actor.Tell(1);
+   actor.Tell(2);
+   EXPECT_EQ((std::vector<int>{1}), events);
+   EXPECT_EQ(2u, actor.Stats().size);
+
+   std::exchange(parked, {}).front().resume();
+   EXPECT_EQ((std::vector<int>{1, -1, 2}), events);
+   std::exchange(parked, {}).front().resume();
+   EXPECT_EQ((std::vector<int>{1, -1, 2, -2}), events);
+   EXPECT_EQ(2u, actor.Stats().processed);
+}
+
+TEST_F(ActorFixture, handler_exception_stops_actor)
+{
+   cr::Actor<int> actor([](int msg) {
+      if (msg < 0)
+         throw std::runtime_error("negative");
+   });
+
+   EXPECT_TRUE(actor.Tell(1));
+   EXPECT_TRUE(actor.Tell(-1));
+   EXPECT_FALSE(actor.Running());
+   EXPECT_FALSE(actor.Tell(2));
+   EXPECT_THROW(actor.EnsureNoException(), std::runtime_error);
+}
+
+TEST_F(ActorFixture, handler_exception_cancels_asks_queued_behind_it)
+{
+   Counter counter;
+   StepwiseActor actor(dispatcher.GetExecutor(), [counter](CounterMsg && msg) mutable {
+      if (auto * add = std::get_if<Add>(&msg); add && add->value < 0)
+         throw std::runtime_error("negative");
+      counter(std::move(msg));
+   });
+   bool canceled = false;
+
+   // more than one batch behind the failing message, so some of it is still in the channel
+   actor.Tell(Add{-1});
+   for (std::size_t i = 0; i < StepwiseActor::MaxBatch + 6; ++i)
+      actor.Tell(Add{1});
+   auto asker = [](StepwiseActor & actor, bool & canceled) -> StepwiseTask {
+      try {
+         co_await actor.Ask<int>(MakeGet());
+      }
+      catch (const cr::CanceledException &) {
+         canceled = true;
+      }
+   }(actor, canceled);
+   asker.Run(dispatcher.GetExecutor());
+
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(canceled);
+   EXPECT_FALSE(asker);
+   EXPECT_FALSE(actor.Running());
+   EXPECT_EQ(0u, actor.Stats().size);
+   EXPECT_EQ(0u, actor.Stats().processed);
+   EXPECT_THROW(actor.EnsureNoException(), std::runtime_error);
+}
+
+TEST_F(ActorFixture, actor_on_strand_owns_state_without_lock)
+{
+   using PoolStrand = cr::Strand<ThreadPool::Executor>;
+   using PoolActor = cr::Actor<CounterMsg, PoolStrand>;
+   constexpr int Posters = 4;
+   constexpr int PostsEach = 1000;
+
+   auto pool = std::make_unique<ThreadPool>(4);
+   PoolActor actor(PoolStrand(pool->GetExecutor()), Counter{});
+
+   std::vector<std::thread> posters;
+   for (int p = 0; p < Posters; ++p) {
+      posters.emplace_back([&actor] {
+         for (int i = 0; i < PostsEach; ++i)
+            actor.Tell(Add{1});
+      });
+   }
+   for (auto & t : posters)
+      t.join();
+
+   std::atomic<int> result = 0;
+   auto asker = [](PoolActor & actor,
+                   std::atomic<int> & result) -> cr::TaskHandle<void, PoolStrand> {
+      result = co_await actor.Ask<int>(MakeGet());
+      result.notify_one();
+   }(actor, result);
+   asker.Run(PoolStrand(pool->GetExecutor()));
+   result.wait(0);
+   EXPECT_EQ(Posters * PostsEach, result.load());
+
+   // the pool finishes all work before it stops, including the end of the actor's loop
+   actor.Stop();
+   pool.reset();
+   EXPECT_FALSE(actor.Running());
+   EXPECT_EQ(0u, actor.Stats().size);
+   EXPECT_EQ(static_cast<std::uint64_t>(Posters * PostsEach + 1), actor.Stats().processed);
+}
+
+} // namespace
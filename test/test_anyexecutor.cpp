@@ -0,0 +1,124 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "allocations.hpp"
+#include "crhandle/anyexecutor.hpp"
+#include "crhandle/deadlinedispatcher.hpp"
+#include "crhandle/prioritydispatcher.hpp"
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/taskutils.hpp"
+#include "dispatcher.hpp"
+
+#include <chrono>
+#include <optional>
+#include <tuple>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+struct AnyExecutorFixture : public ::testing::Test
+{
+   using Task = cr::TaskHandle<void, cr::AnyExecutor>;
+   using IntTask = cr::TaskHandle<int, cr::AnyExecutor>;
+
+   static IntTask Value(int value) { co_return value; }
+
+   static Task Sum(std::optional<int> & out)
+   {
+      auto [a, b] = co_await cr::AllOf(Value(1), Value(2));
+      out = a + b + co_await Value(3);
+   }
+};
+
+TEST_F(AnyExecutorFixture, default_any_executor_runs_inline)
+{
+   std::optional<int> result;
+   auto task = Sum(result);
+   task.Run();
+   EXPECT_EQ(6, result);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(AnyExecutorFixture, any_executor_posts_to_wrapped_executor)
+{
+   ManualDispatcher dispatcher;
+   std::optional<int> result;
+
+   auto task = Sum(result);
+   task.Run(dispatcher.GetExecutor());
+   EXPECT_EQ(1u, dispatcher.queue.size());
+   EXPECT_FALSE(result);
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(1u, dispatcher.batches);
+   EXPECT_EQ(6, result);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(AnyExecutorFixture, any_executor_wraps_closures)
+{
+   ManualDispatcher dispatcher;
+   cr::AnyExecutor executor(dispatcher.GetExecutor());
+   int calls = 0;
+
+   executor.Execute([&calls] { ++calls; });
+   EXPECT_EQ(0, calls);
+   dispatcher.ProcessAll();
+   EXPECT_EQ(1, calls);
+}
+
+TEST_F(AnyExecutorFixture, any_executor_copies_compare_equal_to_wrapped_executor)
+{
+   ManualDispatcher dispatcher1;
+   ManualDispatcher dispatcher2;
+   cr::AnyExecutor executor1(dispatcher1.GetExecutor());
+   cr::AnyExecutor executor2(dispatcher2.GetExecutor());
+   cr::AnyExecutor copy = executor1;
+
+   EXPECT_TRUE(copy == executor1);
+   EXPECT_FALSE(copy == executor2);
+   EXPECT_FALSE(copy == cr::AnyExecutor{});
+   EXPECT_TRUE(cr::AnyExecutor{} == cr::AnyExecutor{});
+
+   copy = executor2;
+   ASSERT_NE(nullptr, copy.Target<ManualDispatcher::Executor>());
+   EXPECT_EQ(&dispatcher2, copy.Target<ManualDispatcher::Executor>()->master);
+   EXPECT_EQ(nullptr, copy.Target<cr::InlineExecutor>());
+}
+
+TEST_F(AnyExecutorFixture, any_executor_forwards_deadline_and_time_slice_queries)
+{
+   cr::DeadlineDispatcher<> deadlines(true);
+   cr::AnyExecutor late(deadlines.GetExecutor(std::chrono::steady_clock::time_point{}));
+   bool expired = false;
+   late.Execute([&] { expired = late.Expired(); });
+   deadlines.ProcessAll();
+   EXPECT_TRUE(expired);
+   EXPECT_FALSE(cr::AnyExecutor{}.Expired());
+
+   cr::PriorityDispatcher slicing({8, 4, 1}, 1us);
+   cr::AnyExecutor sliced(slicing.GetExecutor());
+   bool shouldYield = false;
+   sliced.Execute([&] {
+      const auto start = std::chrono::steady_clock::now();
+      while (std::chrono::steady_clock::now() - start < 100us)
+         ;
+      shouldYield = sliced.ShouldYield();
+   });
+   slicing.ProcessAll();
+   EXPECT_TRUE(shouldYield);
+   EXPECT_FALSE(cr::AnyExecutor{}.ShouldYield());
+}
+
+TEST_F(AnyExecutorFixture, any_executor_doesnt_allocate)
+{
+   cr::PriorityDispatcher dispatcher;
+   const auto allocationsBefore = AllocationCount();
+   cr::AnyExecutor executor(dispatcher.GetExecutor());
+   cr::AnyExecutor copy = executor;
+   copy = cr::AnyExecutor{};
+   EXPECT_EQ(allocationsBefore, AllocationCount());
+}
+
+} // namespace
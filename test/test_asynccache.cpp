@@ -0,0 +1,171 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/asynccache.hpp"
+#include "crhandle/detachedhandle.hpp"
+#include "dispatcher.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+struct FakeClock
+{
+   using rep = std::int64_t;
+   using period = std::milli;
+   using duration = std::chrono::duration<rep, period>;
+   using time_point = std::chrono::time_point<FakeClock>;
+   static constexpr bool is_steady = true;
+
+   static inline time_point current{};
+   static time_point now() noexcept { return current; }
+};
+
+struct AsyncCacheFixture : public ::testing::Test
+{
+   using StepwiseTask = cr::TaskHandle<void, ManualDispatcher::Executor>;
+   using StepwiseCache = cr::AsyncCache<int, std::string, ManualDispatcher::Executor>;
+   using ImmediateCache = cr::AsyncCache<int, std::string, cr::InlineExecutor, FakeClock>;
+
+   void SetUp() override { FakeClock::current = FakeClock::time_point{}; }
+
+   // Returns the loader for ImmediateCache, counting the loads of each key
+   auto Loader()
+   {
+      return [this](int key) -> cr::TaskHandle<std::string> {
+         loads.push_back(key);
+         co_return std::to_string(key);
+      };
+   }
+
+   // Awaits key in a detached coroutine, which doesn't suspend for an ImmediateCache
+   void Get(ImmediateCache & cache, int key)
+   {
+      static auto Lookup = [](ImmediateCache & cache,
+                              int key,
+                              auto loader,
+                              std::vector<std::string> & values) -> cr::DetachedHandle {
+         values.push_back(co_await cache.Get(key, loader));
+      };
+      Lookup(cache, key, Loader(), values);
+   }
+
+   std::vector<int> loads;
+   std::vector<std::string> values;
+};
+
+TEST_F(AsyncCacheFixture, concurrent_misses_share_one_load)
+{
+   ManualDispatcher dispatcher;
+   StepwiseCache cache({}, dispatcher.GetExecutor());
+   int loadCount = 0;
+
+   using LoadTask = cr::TaskHandle<std::string, ManualDispatcher::Executor>;
+   static auto Load = [](int & loadCount) -> LoadTask {
+      ++loadCount;
+      co_return "value";
+   };
+   static auto Lookup = [](StepwiseCache & cache,
+                           int & loadCount,
+                           std::vector<std::string> & values) -> StepwiseTask {
+      values.push_back(co_await cache.Get(1, [&] { return Load(loadCount); }));
+   };
+
+   std::vector<StepwiseTask> tasks;
+   for (int i = 0; i < 5; ++i) {
+      tasks.push_back(Lookup(cache, loadCount, values));
+      tasks.back().Run(dispatcher.GetExecutor());
+   }
+   dispatcher.ProcessAll();
+
+   EXPECT_EQ(1, loadCount);
+   EXPECT_EQ(std::vector<std::string>(5, "value"), values);
+   EXPECT_EQ(1u, cache.Size());
+}
+
+TEST_F(AsyncCacheFixture, loaded_value_is_returned_without_suspending)
+{
+   ImmediateCache cache;
+
+   Get(cache, 1);
+   EXPECT_EQ((std::vector<int>{1}), loads);
+
+   auto awaiter = cache.Get(1, Loader());
+   EXPECT_TRUE(awaiter.await_ready());
+   EXPECT_EQ("1", awaiter.await_resume());
+   EXPECT_EQ((std::vector<int>{1}), loads);
+}
+
+TEST_F(AsyncCacheFixture, least_recently_used_entry_is_evicted)
+{
+   ImmediateCache cache({.capacity = 2});
+
+   Get(cache, 1);
+   Get(cache, 2);
+   Get(cache, 1);
+   Get(cache, 3);
+   EXPECT_EQ(2u, cache.Size());
+   Get(cache, 1);
+   Get(cache, 2);
+   EXPECT_EQ((std::vector<int>{1, 2, 3, 2}), loads);
+   EXPECT_EQ((std::vector<std::string>{"1", "2", "1", "3", "1", "2"}), values);
+}
+
+TEST_F(AsyncCacheFixture, entry_is_reloaded_after_ttl)
+{
+   ImmediateCache cache({.ttl = 10ms});
+
+   Get(cache, 1);
+   FakeClock::current += 9ms;
+   Get(cache, 1);
+   EXPECT_EQ((std::vector<int>{1}), loads);
+
+   FakeClock::current += 1ms;
+   Get(cache, 1);
+   EXPECT_EQ((std::vector<int>{1, 1}), loads);
+}
+
+TEST_F(AsyncCacheFixture, failed_load_is_not_cached)
+{
+   ImmediateCache cache;
+   int attempts = 0;
+
+   auto Failing = [&attempts]() -> cr::TaskHandle<std::string> {
+      ++attempts;
+      throw std::runtime_error("backend down");
+      co_return "";
+   };
+   for (int i = 0; i < 2; ++i) {
+      [](ImmediateCache & cache, auto loader) -> cr::DetachedHandle {
+         EXPECT_THROW(co_await cache.Get(1, loader), std::runtime_error);
+      }(cache, Failing);
+   }
+   EXPECT_EQ(2, attempts);
+
+   Get(cache, 1);
+   EXPECT_EQ((std::vector<std::string>{"1"}), values);
+}
+
+TEST_F(AsyncCacheFixture, invalidated_entry_is_reloaded)
+{
+   ImmediateCache cache;
+
+   Get(cache, 1);
+   Get(cache, 2);
+   cache.Invalidate(1);
+   EXPECT_EQ(1u, cache.Size());
+   Get(cache, 1);
+   Get(cache, 2);
+   EXPECT_EQ((std::vector<int>{1, 2, 1}), loads);
+
+   cache.Clear();
+   EXPECT_EQ(0u, cache.Size());
+}
+
+} // namespace
@@ -0,0 +1,215 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "counter.hpp"
+#include "crhandle/asyncscope.hpp"
+#include "crhandle/detachedhandle.hpp"
+#include "threadpool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct AsyncScopeFixture : public ::testing::Test
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool done = false;
+   };
+   struct Awaitable
+   {
+      State & state;
+      bool await_ready() { return false; }
+      void await_suspend(stdcr::coroutine_handle<> h) { state.handle = h; }
+      void await_resume() {}
+   };
+
+   static cr::TaskHandle<void> Inner(State & s, Counter counter)
+   {
+      (void)counter;
+      co_await Awaitable{s};
+      s.done = true;
+   }
+   static cr::TaskHandle<void> Outer(State & s, Counter counter)
+   {
+      co_await Inner(s, counter);
+   }
+
+   cr::DetachedHandle Join(cr::AsyncScope & scope, bool & joined)
+   {
+      co_await scope.Join();
+      joined = true;
+   }
+
+   int count = 0;
+};
+
+TEST_F(AsyncScopeFixture, join_waits_for_all_children)
+{
+   cr::AsyncScope scope;
+   State state1;
+   State state2;
+   bool joined = false;
+
+   scope.Spawn(cr::InlineExecutor{}, [&] {
+      return Outer(state1, Counter(count));
+   });
+   scope.Spawn(cr::InlineExecutor{}, [&] {
+      return Outer(state2, Counter(count));
+   });
+   EXPECT_EQ(2u, scope.Live());
+
+   Join(scope, joined);
+   EXPECT_FALSE(joined);
+
+   state1.handle.resume();
+   EXPECT_TRUE(state1.done);
+   EXPECT_FALSE(joined);
+
+   state2.handle.resume();
+   EXPECT_TRUE(state2.done);
+   EXPECT_TRUE(joined);
+   EXPECT_EQ(0u, scope.Live());
+   EXPECT_EQ(0, count);
+}
+
+TEST_F(AsyncScopeFixture, request_stop_cancels_nested_children)
+{
+   cr::AsyncScope scope;
+   State state1;
+   State state2;
+   bool joined = false;
+
+   scope.Spawn(cr::InlineExecutor{}, [&] {
+      return Outer(state1, Counter(count));
+   });
+   scope.Spawn(cr::InlineExecutor{}, [&] {
+      return Outer(state2, Counter(count));
+   });
+   Join(scope, joined);
+
+   scope.RequestStop();
+   EXPECT_TRUE(scope.StopRequested());
+   EXPECT_EQ(2u, scope.Live());
+
+   state1.handle.resume();
+   state2.handle.resume();
+   EXPECT_FALSE(state1.done);
+   EXPECT_FALSE(state2.done);
+   EXPECT_TRUE(joined);
+   EXPECT_EQ(0u, scope.Live());
+   EXPECT_EQ(0, count);
+}
+
+TEST_F(AsyncScopeFixture, children_spawned_after_stop_dont_run)
+{
+   cr::AsyncScope scope;
+   State state;
+   scope.RequestStop();
+
+   scope.Spawn(cr::InlineExecutor{}, [&] {
+      return Outer(state, Counter(count));
+   });
+   EXPECT_FALSE(state.handle);
+   EXPECT_EQ(0u, scope.Live());
+   EXPECT_EQ(0, count);
+}
+
+TEST_F(AsyncScopeFixture, join_rethrows_first_failure)
+{
+   cr::AsyncScope scope;
+   State state;
+   bool failed = false;
+
+   static auto Failing = [](State & s, const char * what) -> cr::TaskHandle<void> {
+      co_await Awaitable{s};
+      throw std::runtime_error(what);
+   };
+
+   scope.Spawn(cr::InlineExecutor{}, [&] {
+      return Failing(state, "first");
+   });
+   State other;
+   scope.Spawn(cr::InlineExecutor{}, [&] {
+      return Failing(other, "second");
+   });
+
+   auto Joiner = [&]() -> cr::DetachedHandle {
+      try {
+         co_await scope.Join();
+      }
+      catch (const std::runtime_error & e) {
+         failed = std::string(e.what()) == "first";
+      }
+   };
+   Joiner();
+   state.handle.resume();
+   EXPECT_FALSE(failed);
+   other.handle.resume();
+   EXPECT_TRUE(failed);
+}
+
+TEST_F(AsyncScopeFixture, children_can_be_spawned_and_stopped_from_several_threads)
+{
+   cr::AsyncScope scope;
+   std::atomic<int> finished = 0;
+   constexpr int ThreadCount = 4;
+   constexpr int TasksPerThread = 1000;
+
+   static auto Task = [](std::atomic<int> & finished) -> cr::TaskHandle<void> {
+      co_await cr::Yield();
+      finished.fetch_add(1, std::memory_order_relaxed);
+   };
+
+   std::vector<std::thread> threads;
+   for (int t = 0; t < ThreadCount; ++t) {
+      threads.emplace_back([&] {
+         for (int i = 0; i < TasksPerThread; ++i)
+            scope.Spawn(cr::InlineExecutor{}, [&] {
+               return Task(finished);
+            });
+         scope.RequestStop();
+      });
+   }
+   for (auto & t : threads)
+      t.join();
+
+   EXPECT_TRUE(scope.StopRequested());
+   EXPECT_EQ(0u, scope.Live());
+   EXPECT_GE(ThreadCount * TasksPerThread, finished.load());
+}
+
+TEST_F(AsyncScopeFixture, scope_can_be_destroyed_right_after_join_on_another_thread)
+{
+   constexpr int Rounds = 2000;
+   ThreadPool pool(2);
+
+   // the last child finishes on a pool thread while the test thread joins and destroys the scope
+   for (int round = 0; round < Rounds; ++round) {
+      auto scope = std::make_unique<cr::AsyncScope>();
+      State state;
+      std::atomic<bool> destroyed = false;
+      scope->Spawn(cr::InlineExecutor{}, [&state]() -> cr::TaskHandle<void> {
+         co_await Awaitable{state};
+      });
+      ASSERT_TRUE(state.handle);
+
+      pool.GetExecutor().Execute(state.handle);
+      [](std::unique_ptr<cr::AsyncScope> & scope,
+         std::atomic<bool> & destroyed) -> cr::DetachedHandle {
+         co_await scope->Join();
+         scope.reset();
+         destroyed = true;
+         destroyed.notify_one();
+      }(scope, destroyed);
+      destroyed.wait(false);
+   }
+}
+
+} // namespace
@@ -0,0 +1,258 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/broadcastchannel.hpp"
+#include "crhandle/detachedhandle.hpp"
+#include "dispatcher.hpp"
+
+#include <vector>
+
+namespace {
+
+struct BroadcastChannelFixture : public ::testing::Test
+{
+   using ImmediateChannel = cr::BroadcastChannel<std::unique_ptr<int>>;
+   using StepwiseChannel = cr::BroadcastChannel<std::unique_ptr<int>, ManualDispatcher::Executor>;
+   using StepwiseTask = cr::TaskHandle<void, ManualDispatcher::Executor>;
+
+   static cr::DetachedHandle ReceiveOne(ImmediateChannel::Subscriber & sub,
+                                        ImmediateChannel::ItemPtr & out)
+   {
+      out = co_await sub.Receive();
+   }
+
+   static cr::DetachedHandle ReceiveAll(ImmediateChannel::Subscriber & sub,
+                                        std::vector<int> & out,
+                                        bool & canceled)
+   {
+      try {
+         while (true)
+            out.push_back(**co_await sub.Receive());
+      }
+      catch (const cr::CanceledException &) {
+         canceled = true;
+      }
+   }
+};
+
+TEST_F(BroadcastChannelFixture, broadcast_immediate_delivers_same_item_to_all_subscribers)
+{
+   auto ch = ImmediateChannel::Make(4);
+   ImmediateChannel::Producer prod(ch);
+   ImmediateChannel::Subscriber sub1(ch);
+   ImmediateChannel::Subscriber sub2(ch);
+
+   ImmediateChannel::ItemPtr result1;
+   ImmediateChannel::ItemPtr result2;
+   ReceiveOne(sub1, result1);
+   ReceiveOne(sub2, result2);
+   EXPECT_FALSE(result1);
+   EXPECT_FALSE(result2);
+
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(42)));
+   ASSERT_TRUE(result1);
+   EXPECT_EQ(42, **result1);
+   EXPECT_EQ(result1.get(), result2.get());
+}
+
+TEST_F(BroadcastChannelFixture, broadcast_immediate_buffers_items_for_each_subscriber)
+{
+   auto ch = ImmediateChannel::Make(4);
+   ImmediateChannel::Producer prod(ch);
+   ImmediateChannel::Subscriber sub1(ch);
+
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(1)));
+
+   ImmediateChannel::Subscriber sub2(ch);
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(2)));
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(3)));
+
+   std::vector<int> received1;
+   std::vector<int> received2;
+   bool canceled1 = false;
+   bool canceled2 = false;
+   ReceiveAll(sub1, received1, canceled1);
+   ReceiveAll(sub2, received2, canceled2);
+
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), received1);
+   EXPECT_EQ((std::vector<int>{2, 3}), received2);
+   EXPECT_FALSE(canceled1);
+   EXPECT_FALSE(canceled2);
+
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(4)));
+   EXPECT_EQ((std::vector<int>{1, 2, 3, 4}), received1);
+   EXPECT_EQ((std::vector<int>{2, 3, 4}), received2);
+
+   ch.reset();
+   EXPECT_TRUE(canceled1);
+   EXPECT_TRUE(canceled2);
+   EXPECT_FALSE(prod.Send(std::make_unique<int>(5)));
+}
+
+TEST_F(BroadcastChannelFixture, broadcast_lagging_subscriber_skips_overwritten_items)
+{
+   auto ch = ImmediateChannel::Make(2, cr::SlowSubscriberPolicy::Lag);
+   ImmediateChannel::Producer prod(ch);
+   ImmediateChannel::Subscriber slow(ch);
+   ImmediateChannel::Subscriber fast(ch);
+
+   std::vector<int> fastReceived;
+   bool fastCanceled = false;
+   ReceiveAll(fast, fastReceived, fastCanceled);
+
+   for (int i = 1; i <= 5; ++i)
+      EXPECT_TRUE(prod.Send(std::make_unique<int>(i)));
+   EXPECT_EQ((std::vector<int>{1, 2, 3, 4, 5}), fastReceived);
+   EXPECT_EQ(0u, fast.Missed());
+
+   std::vector<int> slowReceived;
+   bool slowCanceled = false;
+   ReceiveAll(slow, slowReceived, slowCanceled);
+   EXPECT_EQ((std::vector<int>{4, 5}), slowReceived);
+   EXPECT_EQ(3u, slow.Missed());
+   EXPECT_FALSE(slowCanceled);
+
+   ch.reset();
+   EXPECT_TRUE(slowCanceled);
+   EXPECT_TRUE(fastCanceled);
+}
+
+TEST_F(BroadcastChannelFixture, broadcast_slow_subscriber_is_dropped)
+{
+   auto ch = ImmediateChannel::Make(2, cr::SlowSubscriberPolicy::Drop);
+   ImmediateChannel::Producer prod(ch);
+   ImmediateChannel::Subscriber slow(ch);
+   ImmediateChannel::Subscriber fast(ch);
+
+   std::vector<int> fastReceived;
+   bool fastCanceled = false;
+   ReceiveAll(fast, fastReceived, fastCanceled);
+
+   for (int i = 1; i <= 3; ++i)
+      EXPECT_TRUE(prod.Send(std::make_unique<int>(i)));
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), fastReceived);
+
+   std::vector<int> slowReceived;
+   bool slowCanceled = false;
+   ReceiveAll(slow, slowReceived, slowCanceled);
+   EXPECT_TRUE(slowReceived.empty());
+   EXPECT_TRUE(slowCanceled);
+   EXPECT_FALSE(fastCanceled);
+
+   ch.reset();
+   EXPECT_TRUE(fastCanceled);
+}
+
+TEST_F(BroadcastChannelFixture, broadcast_stepwise_resumes_subscribers_on_their_own_executors)
+{
+   ManualDispatcher channelDispatcher;
+   ManualDispatcher subscriberDispatcher1;
+   ManualDispatcher subscriberDispatcher2;
+
+   auto ch =
+      StepwiseChannel::Make(4, cr::SlowSubscriberPolicy::Lag, channelDispatcher.GetExecutor());
+   StepwiseChannel::Producer prod(ch);
+   StepwiseChannel::Subscriber sub1(ch, subscriberDispatcher1.GetExecutor());
+   StepwiseChannel::Subscriber sub2(ch, subscriberDispatcher2.GetExecutor());
+
+   static auto Receive = [](StepwiseChannel::Subscriber & sub, int & out) -> StepwiseTask {
+      out = **co_await sub.Receive();
+   };
+
+   int result1 = 0;
+   int result2 = 0;
+   auto task1 = Receive(sub1, result1);
+   task1.Run(subscriberDispatcher1.GetExecutor());
+   auto task2 = Receive(sub2, result2);
+   task2.Run(subscriberDispatcher2.GetExecutor());
+
+   subscriberDispatcher1.ProcessAll();
+   subscriberDispatcher2.ProcessAll();
+   channelDispatcher.ProcessAll();
+
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(42)));
+   EXPECT_TRUE(channelDispatcher.ProcessOneTask());
+   EXPECT_FALSE(channelDispatcher.ProcessOneTask());
+   EXPECT_EQ(0, result1);
+   EXPECT_EQ(0, result2);
+
+   EXPECT_TRUE(subscriberDispatcher1.ProcessOneTask());
+   EXPECT_EQ(42, result1);
+   EXPECT_EQ(0, result2);
+   EXPECT_FALSE(task1);
+
+   EXPECT_TRUE(subscriberDispatcher2.ProcessOneTask());
+   EXPECT_EQ(42, result2);
+   EXPECT_FALSE(task2);
+}
+
+TEST_F(BroadcastChannelFixture, broadcast_stepwise_wakes_subscribers_on_same_executor_at_once)
+{
+   ManualDispatcher dispatcher;
+
+   auto ch = StepwiseChannel::Make(4, cr::SlowSubscriberPolicy::Lag, dispatcher.GetExecutor());
+   StepwiseChannel::Producer prod(ch);
+   StepwiseChannel::Subscriber sub1(ch, dispatcher.GetExecutor());
+   StepwiseChannel::Subscriber sub2(ch, dispatcher.GetExecutor());
+
+   static auto Receive = [](StepwiseChannel::Subscriber & sub, int & out) -> StepwiseTask {
+      out = **co_await sub.Receive();
+   };
+
+   int result1 = 0;
+   int result2 = 0;
+   auto task1 = Receive(sub1, result1);
+   task1.Run(dispatcher.GetExecutor());
+   auto task2 = Receive(sub2, result2);
+   task2.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(7)));
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(1u, dispatcher.batches);
+   EXPECT_EQ(2u, dispatcher.queue.size());
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(7, result1);
+   EXPECT_EQ(7, result2);
+   EXPECT_FALSE(task1);
+   EXPECT_FALSE(task2);
+}
+
+TEST_F(BroadcastChannelFixture, broadcast_stepwise_unsubscribes_destroyed_subscriber)
+{
+   ManualDispatcher dispatcher;
+
+   auto ch = StepwiseChannel::Make(1, cr::SlowSubscriberPolicy::Drop, dispatcher.GetExecutor());
+   StepwiseChannel::Producer prod(ch);
+   std::optional<StepwiseChannel::Subscriber> idle;
+   idle.emplace(ch, dispatcher.GetExecutor());
+   StepwiseChannel::Subscriber active(ch, dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+
+   idle.reset();
+   dispatcher.ProcessAll();
+
+   static auto Receive = [](StepwiseChannel::Subscriber & sub,
+                            std::vector<int> & out) -> StepwiseTask {
+      while (true)
+         out.push_back(**co_await sub.Receive());
+   };
+
+   std::vector<int> received;
+   auto task = Receive(active, received);
+   task.Run(dispatcher.GetExecutor());
+
+   for (int i = 1; i <= 3; ++i) {
+      EXPECT_TRUE(prod.Send(std::make_unique<int>(i)));
+      dispatcher.ProcessAll();
+   }
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), received);
+   EXPECT_TRUE(task);
+
+   ch.reset();
+   dispatcher.ProcessAll();
+   EXPECT_FALSE(task);
+}
+
+} // namespace
@@ -0,0 +1,185 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "counter.hpp"
+#include "crhandle/deadlinedispatcher.hpp"
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/taskutils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+struct FakeClock
+{
+   using rep = std::int64_t;
+   using period = std::milli;
+   using duration = std::chrono::duration<rep, period>;
+   using time_point = std::chrono::time_point<FakeClock>;
+   static constexpr bool is_steady = true;
+
+   static inline time_point current{};
+   static time_point now() noexcept { return current; }
+};
+
+struct DeadlineDispatcherFixture : public ::testing::Test
+{
+   using Dispatcher = cr::DeadlineDispatcher<FakeClock>;
+   using Task = cr::TaskHandle<void, Dispatcher::Executor>;
+
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   };
+   struct Awaitable
+   {
+      State & state;
+      bool await_ready() { return false; }
+      void await_suspend(stdcr::coroutine_handle<> h) { state.handle = h; }
+      void await_resume() {}
+   };
+
+   void SetUp() override { FakeClock::current = FakeClock::time_point{}; }
+
+   static FakeClock::time_point At(FakeClock::duration d) { return FakeClock::time_point{d}; }
+};
+
+TEST_F(DeadlineDispatcherFixture, earliest_deadline_runs_first_and_ties_run_in_fifo_order)
+{
+   Dispatcher dispatcher;
+   std::vector<int> deadlines;
+   for (int i = 0; i < 100; ++i)
+      deadlines.push_back(i % 37);
+   std::shuffle(deadlines.begin(), deadlines.end(), std::mt19937{42});
+
+   std::vector<std::pair<int, int>> order;
+   for (int i = 0; i < static_cast<int>(deadlines.size()); ++i) {
+      const int deadline = deadlines[static_cast<std::size_t>(i)];
+      dispatcher.GetExecutor(At(FakeClock::duration{deadline})).Execute([&order, deadline, i] {
+         order.emplace_back(deadline, i);
+      });
+   }
+   int last = -1;
+   dispatcher.GetExecutor().Execute([&] {
+      last = static_cast<int>(order.size());
+   });
+
+   EXPECT_EQ(101u, dispatcher.Pending());
+   EXPECT_EQ(101u, dispatcher.ProcessAll());
+   EXPECT_EQ(100, last);
+   EXPECT_TRUE(std::is_sorted(order.begin(), order.end()));
+   EXPECT_EQ(0u, dispatcher.Pending());
+}
+
+TEST_F(DeadlineDispatcherFixture, nested_tasks_inherit_deadline)
+{
+   using Promise = Task::promise_type;
+   Dispatcher dispatcher;
+
+   static auto Child = [](std::optional<FakeClock::time_point> & out) -> Task {
+      auto handle = co_await cr::CurrentHandle<Promise>();
+      out = handle.promise().Executor().deadline;
+   };
+   static auto Parent = [](std::optional<FakeClock::time_point> & out) -> Task {
+      co_await Child(out);
+   };
+
+   std::optional<FakeClock::time_point> early;
+   std::optional<FakeClock::time_point> late;
+   auto lateTask = Parent(late);
+   lateTask.Run(dispatcher.GetExecutor(At(20ms)));
+   auto earlyTask = Parent(early);
+   earlyTask.Run(dispatcher.GetExecutor(At(10ms)));
+
+   // the child is dispatched, i.e. runs right away on the thread running its parent
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(At(10ms), early);
+   EXPECT_FALSE(late.has_value());
+   EXPECT_EQ(1u, dispatcher.Pending());
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(At(20ms), late);
+   EXPECT_FALSE(earlyTask);
+   EXPECT_FALSE(lateTask);
+}
+
+TEST_F(DeadlineDispatcherFixture, late_tasks_are_canceled_when_dropping_enabled)
+{
+   Dispatcher dispatcher(true);
+   State state;
+   int count = 0;
+   bool dropped = false;
+   bool finished = false;
+
+   static auto Waiting = [](State & s, Counter counter, bool & dropped, bool & finished) -> Task {
+      (void)counter;
+      try {
+         co_await Awaitable{s};
+         finished = true;
+      }
+      catch (const cr::CanceledException &) {
+         dropped = true;
+      }
+   };
+   static auto Immediate = [](Counter counter, bool & finished) -> Task {
+      (void)counter;
+      finished = true;
+      co_return;
+   };
+
+   auto task = Waiting(state, Counter(count), dropped, finished);
+   auto executor = dispatcher.GetExecutor(At(10ms));
+   task.Run(executor);
+   FakeClock::current = At(5ms);
+   dispatcher.ProcessAll();
+   ASSERT_TRUE(state.handle);
+
+   FakeClock::current = At(11ms);
+   executor.Execute(state.handle);
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(dropped);
+   EXPECT_FALSE(finished);
+   EXPECT_FALSE(task);
+
+   auto lateTask = Immediate(Counter(count), finished);
+   lateTask.Run(executor);
+   dispatcher.ProcessAll();
+   EXPECT_FALSE(finished);
+   EXPECT_FALSE(lateTask);
+   EXPECT_THROW(lateTask.EnsureNoException(), cr::CanceledException);
+
+   auto timelyTask = Immediate(Counter(count), finished);
+   timelyTask.Run(executor.WithDeadline(At(20ms)));
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(finished);
+
+   task = {};
+   lateTask = {};
+   timelyTask = {};
+   EXPECT_EQ(0, count);
+}
+
+TEST_F(DeadlineDispatcherFixture, late_tasks_run_when_dropping_disabled)
+{
+   Dispatcher dispatcher;
+   bool finished = false;
+
+   static auto Immediate = [](bool & finished) -> Task {
+      finished = true;
+      co_return;
+   };
+
+   FakeClock::current = At(11ms);
+   auto task = Immediate(finished);
+   task.Run(dispatcher.GetExecutor(At(10ms)));
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(finished);
+}
+
+} // namespace
@@ -0,0 +1,132 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "allocations.hpp"
+#include "crhandle/detachedhandle.hpp"
+#include "crhandle/oneshot.hpp"
+#include "dispatcher.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace {
+
+struct OneshotFixture : public ::testing::Test
+{
+   using ImmediateOneshot = cr::Oneshot<std::unique_ptr<int>>;
+   using StepwiseOneshot = cr::Oneshot<std::unique_ptr<int>, ManualDispatcher::Executor>;
+   using StepwiseTask = cr::TaskHandle<void, ManualDispatcher::Executor>;
+
+   ManualDispatcher dispatcher;
+};
+
+TEST_F(OneshotFixture, oneshot_set_then_receive_doesnt_suspend)
+{
+   auto [sender, receiver] = ImmediateOneshot::Make();
+   int received = 0;
+
+   EXPECT_TRUE(sender.Set(std::make_unique<int>(42)));
+   EXPECT_FALSE(sender.Set(std::make_unique<int>(43)));
+
+   [](ImmediateOneshot::Receiver & receiver, int & received) -> cr::DetachedHandle {
+      received = *co_await receiver.Receive();
+   }(receiver, received);
+   EXPECT_EQ(42, received);
+}
+
+TEST_F(OneshotFixture, oneshot_receiver_is_resumed_through_its_executor)
+{
+   auto [sender, receiver] = StepwiseOneshot::Make(dispatcher.GetExecutor());
+   int received = 0;
+
+   auto task = [](StepwiseOneshot::Receiver & receiver, int & received) -> StepwiseTask {
+      received = *co_await receiver.Receive();
+   }(receiver, received);
+   task.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_EQ(0, received);
+
+   EXPECT_TRUE(sender.Set(std::make_unique<int>(42)));
+   EXPECT_EQ(0, received);
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(42, received);
+
+   dispatcher.ProcessAll();
+   EXPECT_FALSE(task);
+}
+
+TEST_F(OneshotFixture, oneshot_receive_throws_when_sender_dies)
+{
+   auto [sender, receiver] = ImmediateOneshot::Make();
+   bool canceled = false;
+
+   [](ImmediateOneshot::Receiver & receiver, bool & canceled) -> cr::DetachedHandle {
+      try {
+         co_await receiver.Receive();
+      }
+      catch (const cr::CanceledException &) {
+         canceled = true;
+      }
+   }(receiver, canceled);
+   EXPECT_FALSE(canceled);
+
+   { auto dying = std::move(sender); }
+   EXPECT_TRUE(canceled);
+}
+
+TEST_F(OneshotFixture, oneshot_sender_notices_when_receiver_dies)
+{
+   auto [sender, receiver] = ImmediateOneshot::Make();
+   EXPECT_FALSE(sender.ReceiverGone());
+
+   { auto dying = std::move(receiver); }
+   EXPECT_TRUE(sender.ReceiverGone());
+   EXPECT_FALSE(sender.Set(std::make_unique<int>(42)));
+}
+
+TEST_F(OneshotFixture, oneshot_canceled_task_unwinds_when_value_arrives)
+{
+   auto [sender, receiver] = StepwiseOneshot::Make(dispatcher.GetExecutor());
+   bool received = false;
+
+   auto task = [](StepwiseOneshot::Receiver & receiver, bool & received) -> StepwiseTask {
+      co_await receiver.Receive();
+      received = true;
+   }(receiver, received);
+   task.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+
+   task = {};
+   EXPECT_TRUE(sender.Set(std::make_unique<int>(42)));
+   dispatcher.ProcessAll();
+   EXPECT_FALSE(received);
+}
+
+TEST_F(OneshotFixture, oneshot_makes_a_single_allocation)
+{
+   const auto allocationsBefore = AllocationCount();
+   {
+      auto [sender, receiver] = cr::Oneshot<int>::Make();
+      EXPECT_TRUE(sender.Set(42));
+   }
+   EXPECT_EQ(allocationsBefore + 1, AllocationCount());
+}
+
+TEST_F(OneshotFixture, oneshot_hands_value_over_to_another_thread)
+{
+   for (int i = 0; i < 100; ++i) {
+      auto [sender, receiver] = cr::Oneshot<int>::Make();
+      std::atomic<int> received = 0;
+
+      [](cr::Oneshot<int>::Receiver & receiver, std::atomic<int> & received) -> cr::DetachedHandle {
+         received = co_await receiver.Receive();
+      }(receiver, received);
+
+      std::thread t([&, sender = std::move(sender), i]() mutable { sender.Set(i + 1); });
+      t.join();
+      EXPECT_EQ(i + 1, received.load());
+   }
+}
+
+} // namespace
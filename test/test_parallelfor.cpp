@@ -0,0 +1,121 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/detachedhandle.hpp"
+#include "crhandle/parallelfor.hpp"
+#include "dispatcher.hpp"
+#include "threadpool.hpp"
+
+#include <atomic>
+#include <numeric>
+#include <ranges>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct ParallelForFixture : public ::testing::Test
+{
+   using StepwiseTask = cr::TaskHandle<void, ManualDispatcher::Executor>;
+
+   ManualDispatcher dispatcher;
+};
+
+TEST_F(ParallelForFixture, parallel_for_posts_chunks_in_one_batch_and_resumes_once)
+{
+   std::vector<int> data(10, 1);
+   int resumed = 0;
+
+   auto task = [](ManualDispatcher::Executor executor,
+                  std::vector<int> & data,
+                  int & resumed) -> StepwiseTask {
+      co_await cr::ParallelFor(executor, data, 4, [](int & x) { x *= 2; });
+      ++resumed;
+   }(dispatcher.GetExecutor(), data, resumed);
+   task.Run(dispatcher.GetExecutor());
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(1u, dispatcher.batches);
+   EXPECT_EQ(3u, dispatcher.queue.size());
+
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(0, resumed);
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(1, resumed);
+   EXPECT_FALSE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(std::vector<int>(10, 2), data);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(ParallelForFixture, parallel_for_over_empty_range_doesnt_suspend)
+{
+   std::vector<int> data;
+   bool done = false;
+
+   [](ManualDispatcher::Executor executor,
+      std::vector<int> & data,
+      bool & done) -> cr::DetachedHandle {
+      co_await cr::ParallelFor(executor, data, 4, [](int &) { FAIL(); });
+      done = true;
+   }(dispatcher.GetExecutor(), data, done);
+   EXPECT_TRUE(done);
+   EXPECT_TRUE(dispatcher.queue.empty());
+}
+
+TEST_F(ParallelForFixture, parallel_for_with_inline_executor_runs_synchronously)
+{
+   int sum = 0;
+
+   [](int & sum) -> cr::DetachedHandle {
+      co_await cr::ParallelFor(cr::InlineExecutor{}, std::views::iota(1, 11), 3, [&](int x) {
+         sum += x;
+      });
+   }(sum);
+   EXPECT_EQ(55, sum);
+}
+
+TEST_F(ParallelForFixture, parallel_for_rethrows_first_exception)
+{
+   std::vector<int> data(8);
+   std::iota(data.begin(), data.end(), 0);
+   bool caught = false;
+
+   auto task = [](ManualDispatcher::Executor executor,
+                  std::vector<int> & data,
+                  bool & caught) -> StepwiseTask {
+      try {
+         co_await cr::ParallelFor(executor, data, 2, [](int x) {
+            if (x >= 2)
+               throw std::runtime_error("bad element");
+         });
+      }
+      catch (const std::runtime_error &) {
+         caught = true;
+      }
+   }(dispatcher.GetExecutor(), data, caught);
+   task.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(caught);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(ParallelForFixture, parallel_for_runs_chunks_on_thread_pool)
+{
+   std::vector<std::atomic<int>> hits(10000);
+   std::atomic<bool> done = false;
+   ThreadPool pool(4); // joins its threads before the above go away
+
+   [](ThreadPool::Executor executor,
+      std::vector<std::atomic<int>> & hits,
+      std::atomic<bool> & done) -> cr::DetachedHandle {
+      co_await cr::ParallelFor(executor, hits, 64, [](std::atomic<int> & h) { ++h; });
+      done = true;
+      done.notify_one();
+   }(pool.GetExecutor(), hits, done);
+
+   done.wait(false);
+   for (const auto & h : hits)
+      EXPECT_EQ(1, h.load());
+}
+
+} // namespace
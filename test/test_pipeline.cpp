@@ -0,0 +1,203 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/detachedhandle.hpp"
+#include "crhandle/pipeline.hpp"
+#include "dispatcher.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct PipelineFixture : public ::testing::Test
+{
+   using Executor = ManualDispatcher::Executor;
+
+   static cr::DetachedHandle PushAll(cr::Pipeline<int> & pipeline, std::vector<int> items)
+   {
+      for (int item : items)
+         co_await pipeline.Push(item);
+   }
+
+   static cr::DetachedHandle CloseAndJoin(cr::Pipeline<int> & pipeline, bool & joined)
+   {
+      pipeline.Close();
+      co_await pipeline.Join();
+      joined = true;
+   }
+
+   ManualDispatcher dispatcher;
+};
+
+TEST_F(PipelineFixture, pipeline_passes_items_through_all_stages_in_order)
+{
+   std::vector<std::string> out;
+   auto pipeline = cr::MakePipeline<int>()
+                      .Stage([](int x) { return x * 2; })
+                      .Stage([](int x) { return std::to_string(x); })
+                      .Sink([&out](std::string s) { out.push_back(std::move(s)); });
+   EXPECT_EQ(3u, pipeline.StageCount());
+
+   PushAll(pipeline, {1, 2, 3});
+   EXPECT_EQ((std::vector<std::string>{"2", "4", "6"}), out);
+
+   bool joined = false;
+   CloseAndJoin(pipeline, joined);
+   EXPECT_TRUE(joined);
+}
+
+TEST_F(PipelineFixture, pipeline_workers_take_items_in_batches)
+{
+   std::vector<int> out;
+   auto pipeline =
+      cr::MakePipeline<int>()
+         .Stage([](int x) { return x + 1; }, {.capacity = 8, .batch = 4}, dispatcher.GetExecutor())
+         .Sink([&out](int x) { out.push_back(x); }, {}, dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+
+   std::vector<int> items{0, 1, 2, 3, 4, 5, 6, 7};
+   bool pushed = false;
+   [](cr::Pipeline<int> & pipeline, std::vector<int> & items, bool & pushed) -> cr::DetachedHandle {
+      pushed = co_await pipeline.Push(std::span(items));
+   }(pipeline, items, pushed);
+   EXPECT_TRUE(pushed);
+   // the parked worker has already been handed its first batch
+   EXPECT_EQ(4u, pipeline.QueueDepth(0));
+
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(0u, pipeline.QueueDepth(0));
+   EXPECT_EQ(4u, pipeline.QueueDepth(1));
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ((std::vector<int>{1, 2, 3, 4, 5, 6, 7, 8}), out);
+
+   bool joined = false;
+   CloseAndJoin(pipeline, joined);
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(joined);
+}
+
+TEST_F(PipelineFixture, pipeline_push_suspends_while_first_queue_is_full)
+{
+   std::vector<int> out;
+   auto pipeline = cr::MakePipeline<int>()
+                      .Stage([](int x) { return x; }, {.capacity = 2}, dispatcher.GetExecutor())
+                      .Sink([&out](int x) { out.push_back(x); }, {}, dispatcher.GetExecutor());
+
+   PushAll(pipeline, {1, 2, 3, 4, 5});
+   EXPECT_EQ(2u, pipeline.QueueDepth(0));
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(0u, pipeline.QueueDepth(0));
+   EXPECT_EQ((std::vector<int>{1, 2, 3, 4, 5}), out);
+
+   bool joined = false;
+   CloseAndJoin(pipeline, joined);
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(joined);
+}
+
+TEST_F(PipelineFixture, pipeline_stage_may_be_a_coroutine_and_have_several_workers)
+{
+   std::vector<int> out;
+   auto pipeline = cr::MakePipeline<int>()
+                      .Stage(
+                         [](int x) -> cr::TaskHandle<int, Executor> { co_return x * 10; },
+                         {.workers = 3, .batch = 1},
+                         dispatcher.GetExecutor())
+                      .Sink([&out](int x) { out.push_back(x); }, {}, dispatcher.GetExecutor());
+   EXPECT_EQ(4u, dispatcher.queue.size());
+
+   PushAll(pipeline, {1, 2, 3});
+   dispatcher.ProcessAll();
+   std::sort(out.begin(), out.end());
+   EXPECT_EQ((std::vector<int>{10, 20, 30}), out);
+
+   bool joined = false;
+   CloseAndJoin(pipeline, joined);
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(joined);
+}
+
+TEST_F(PipelineFixture, pipeline_failing_stage_closes_pipeline_and_join_rethrows)
+{
+   std::vector<int> out;
+   auto pipeline = cr::MakePipeline<int>()
+                      .Stage([](int x) {
+                         if (x == 2)
+                            throw std::runtime_error("bad item");
+                         return x;
+                      })
+                      .Sink([&out](int x) { out.push_back(x); });
+
+   PushAll(pipeline, {1, 2});
+   EXPECT_EQ((std::vector<int>{1}), out);
+
+   bool accepted = true;
+   [](cr::Pipeline<int> & pipeline, bool & accepted) -> cr::DetachedHandle {
+      accepted = co_await pipeline.Push(3);
+   }(pipeline, accepted);
+   EXPECT_FALSE(accepted);
+
+   bool caught = false;
+   [](cr::Pipeline<int> & pipeline, bool & caught) -> cr::DetachedHandle {
+      try {
+         co_await pipeline.Join();
+      }
+      catch (const std::runtime_error &) {
+         caught = true;
+      }
+   }(pipeline, caught);
+   EXPECT_TRUE(caught);
+}
+
+TEST_F(PipelineFixture, pipeline_stop_cancels_workers)
+{
+   int processed = 0;
+   auto pipeline = cr::MakePipeline<int>()
+                      .Stage([](int x) { return x; }, {}, dispatcher.GetExecutor())
+                      .Sink([&processed](int) { ++processed; }, {}, dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+
+   PushAll(pipeline, {1, 2, 3});
+   pipeline.Stop();
+   bool joined = false;
+   [](cr::Pipeline<int> & pipeline, bool & joined) -> cr::DetachedHandle {
+      co_await pipeline.Join();
+      joined = true;
+   }(pipeline, joined);
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(joined);
+   EXPECT_EQ(0, processed);
+}
+
+TEST_F(PipelineFixture, pipeline_stop_wakes_idle_workers)
+{
+   auto pipeline = cr::MakePipeline<int>()
+                      .Stage([](int x) { return x; }, {.workers = 2}, dispatcher.GetExecutor())
+                      .Sink([](int) {}, {}, dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+
+   // all workers are parked on empty queues
+   pipeline.Stop();
+   bool joined = false;
+   [](cr::Pipeline<int> & pipeline, bool & joined) -> cr::DetachedHandle {
+      co_await pipeline.Join();
+      joined = true;
+   }(pipeline, joined);
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(joined);
+
+   bool accepted = true;
+   [](cr::Pipeline<int> & pipeline, bool & accepted) -> cr::DetachedHandle {
+      accepted = co_await pipeline.Push(1);
+   }(pipeline, accepted);
+   EXPECT_FALSE(accepted);
+}
+
+} // namespace
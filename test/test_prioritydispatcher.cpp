@@ -0,0 +1,276 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "counter.hpp"
+#include "crhandle/prioritydispatcher.hpp"
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/taskowner.hpp"
+#include "crhandle/taskutils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+struct PriorityDispatcherFixture : public ::testing::Test
+{
+   using Task = cr::TaskHandle<void, cr::PriorityDispatcher::Executor>;
+
+   cr::PriorityDispatcher dispatcher;
+   std::vector<cr::Priority> order;
+
+   void PostRecording(cr::Priority priority, std::size_t count)
+   {
+      for (std::size_t i = 0; i < count; ++i)
+         dispatcher.GetExecutor(priority).Execute([this, priority] {
+            order.push_back(priority);
+         });
+   }
+
+   std::size_t CountInFirst(std::size_t n, cr::Priority priority) const
+   {
+      return static_cast<std::size_t>(
+         std::count(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(n), priority));
+   }
+};
+
+TEST_F(PriorityDispatcherFixture, busy_classes_share_turns_by_weight)
+{
+   PostRecording(cr::Priority::Low, 26);
+   PostRecording(cr::Priority::Normal, 26);
+   PostRecording(cr::Priority::High, 26);
+
+   EXPECT_EQ(78u, dispatcher.ProcessAll());
+   ASSERT_EQ(78u, order.size());
+   EXPECT_EQ(cr::Priority::High, order.front());
+
+   EXPECT_EQ(16u, CountInFirst(26, cr::Priority::High));
+   EXPECT_EQ(8u, CountInFirst(26, cr::Priority::Normal));
+   EXPECT_EQ(2u, CountInFirst(26, cr::Priority::Low));
+   EXPECT_EQ(26u, CountInFirst(78, cr::Priority::Low));
+}
+
+TEST_F(PriorityDispatcherFixture, lone_class_is_processed_back_to_back)
+{
+   PostRecording(cr::Priority::Low, 3);
+   EXPECT_EQ(3u, dispatcher.Pending(cr::Priority::Low));
+
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   PostRecording(cr::Priority::High, 1);
+   EXPECT_EQ(3u, dispatcher.ProcessAll());
+   EXPECT_EQ((std::vector{cr::Priority::Low,
+                          cr::Priority::High,
+                          cr::Priority::Low,
+                          cr::Priority::Low}),
+             order);
+   EXPECT_FALSE(dispatcher.ProcessOneTask());
+}
+
+TEST_F(PriorityDispatcherFixture, move_only_tasks_are_accepted)
+{
+   auto value = std::make_unique<int>(42);
+   int result = 0;
+   dispatcher.GetExecutor().Execute([value = std::move(value), &result] {
+      result = *value;
+   });
+   std::array<int, 16> large{};
+   large.back() = 43;
+   dispatcher.GetExecutor().Execute([large, &result] {
+      result += large.back();
+   });
+
+   EXPECT_EQ(2u, dispatcher.ProcessAll());
+   EXPECT_EQ(85, result);
+}
+
+TEST_F(PriorityDispatcherFixture, nested_tasks_inherit_priority)
+{
+   using Promise = Task::promise_type;
+
+   static auto Child = [](std::optional<cr::Priority> & out) -> Task {
+      auto handle = co_await cr::CurrentHandle<Promise>();
+      out = handle.promise().Executor().priority;
+   };
+   static auto Parent = [](std::optional<cr::Priority> & out, Counter counter) -> Task {
+      (void)counter;
+      co_await Child(out);
+   };
+
+   int count = 0;
+   std::optional<cr::Priority> highChild;
+   std::optional<cr::Priority> lowChild;
+
+   auto low = Parent(lowChild, Counter(count));
+   low.Run(dispatcher.GetExecutor(cr::Priority::Low));
+   auto high = Parent(highChild, Counter(count));
+   high.Run(dispatcher.GetExecutor(cr::Priority::High));
+
+   // the child is dispatched, i.e. runs right away on the thread running its parent
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(cr::Priority::High, highChild);
+   EXPECT_EQ(0u, dispatcher.Pending(cr::Priority::High));
+   EXPECT_EQ(1u, dispatcher.Pending(cr::Priority::Low));
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(cr::Priority::High, highChild);
+   EXPECT_EQ(cr::Priority::Low, lowChild);
+   EXPECT_FALSE(high);
+   EXPECT_FALSE(low);
+
+   high = {};
+   low = {};
+   EXPECT_EQ(0, count);
+}
+
+TEST_F(PriorityDispatcherFixture, batch_is_queued_in_order_at_executor_priority)
+{
+   std::vector<int> started;
+
+   static auto Record = [](std::vector<int> & out, int value) -> Task {
+      out.push_back(value);
+      co_return;
+   };
+   std::array<Task, 3> tasks{Record(started, 1), Record(started, 2), Record(started, 3)};
+
+   cr::TaskOwner<cr::PriorityDispatcher::Executor> owner(dispatcher.GetExecutor(cr::Priority::Low));
+   owner.StartRootTasks(tasks);
+   EXPECT_EQ(3u, dispatcher.Pending(cr::Priority::Low));
+
+   EXPECT_EQ(3u, dispatcher.ProcessAll());
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), started);
+}
+
+TEST_F(PriorityDispatcherFixture, dispatch_runs_inline_only_on_same_dispatcher_and_priority)
+{
+   auto high = dispatcher.GetExecutor(cr::Priority::High);
+   auto low = dispatcher.GetExecutor(cr::Priority::Low);
+   auto record = [this](cr::Priority priority) {
+      return [this, priority] {
+         order.push_back(priority);
+      };
+   };
+
+   cr::Dispatch(high, record(cr::Priority::High));
+   EXPECT_TRUE(order.empty());
+   EXPECT_EQ(1u, dispatcher.Pending(cr::Priority::High));
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+
+   high.Execute([&] {
+      cr::Dispatch(high, record(cr::Priority::High));
+      cr::Dispatch(low, record(cr::Priority::Low));
+      order.push_back(cr::Priority::Normal);
+   });
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ((std::vector{cr::Priority::High, cr::Priority::High, cr::Priority::Normal}), order);
+   EXPECT_EQ(1u, dispatcher.Pending(cr::Priority::Low));
+}
+
+TEST_F(PriorityDispatcherFixture, nested_dispatch_is_posted_beyond_max_depth)
+{
+   auto executor = dispatcher.GetExecutor();
+   unsigned depth = 0;
+   unsigned maxDepth = 0;
+   unsigned remaining = 100;
+
+   std::function<void()> step = [&] {
+      if (remaining == 0)
+         return;
+      --remaining;
+      ++depth;
+      maxDepth = std::max(maxDepth, depth);
+      cr::Dispatch(executor, step);
+      --depth;
+   };
+   executor.Execute(step);
+
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(cr::internal::MaxDispatchDepth + 1, maxDepth);
+   EXPECT_EQ(1u, dispatcher.Pending(cr::Priority::Normal));
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(0u, remaining);
+}
+
+TEST_F(PriorityDispatcherFixture, finished_child_resumes_parent_without_posting)
+{
+   stdcr::coroutine_handle<> suspended = nullptr;
+   bool finished = false;
+
+   static auto Child = [](stdcr::coroutine_handle<> & out) -> Task {
+      struct Suspend
+      {
+         stdcr::coroutine_handle<> & out;
+         bool await_ready() const noexcept { return false; }
+         void await_suspend(stdcr::coroutine_handle<> h) noexcept { out = h; }
+         void await_resume() const noexcept {}
+      };
+      co_await Suspend{out};
+   };
+   static auto Parent = [](stdcr::coroutine_handle<> & out, bool & finished) -> Task {
+      co_await Child(out);
+      finished = true;
+   };
+
+   auto task = Parent(suspended, finished);
+   task.Run(dispatcher.GetExecutor());
+   EXPECT_EQ(1u, dispatcher.ProcessAll());
+   ASSERT_TRUE(suspended);
+
+   dispatcher.GetExecutor().Execute(suspended);
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_TRUE(finished);
+   EXPECT_EQ(0u, dispatcher.Pending(cr::Priority::Normal));
+   EXPECT_FALSE(task);
+}
+
+TEST_F(PriorityDispatcherFixture, exceeded_time_slice_forces_yield_at_ready_co_await)
+{
+   cr::PriorityDispatcher slicing({8, 4, 1}, 100us);
+   bool finished = false;
+
+   static auto Busy = [](bool & finished) -> Task {
+      const auto start = std::chrono::steady_clock::now();
+      while (std::chrono::steady_clock::now() - start < 300us)
+         ;
+      co_await stdcr::suspend_never{};
+      co_await stdcr::suspend_never{};
+      finished = true;
+   };
+
+   auto task = Busy(finished);
+   task.Run(slicing.GetExecutor(cr::Priority::Low));
+   EXPECT_TRUE(slicing.ProcessOneTask());
+   EXPECT_FALSE(finished);
+   EXPECT_EQ(1u, slicing.Pending(cr::Priority::Low));
+
+   EXPECT_EQ(1u, slicing.ProcessAll());
+   EXPECT_TRUE(finished);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(PriorityDispatcherFixture, ready_co_await_continues_synchronously_without_time_slice)
+{
+   bool finished = false;
+
+   static auto Busy = [](bool & finished) -> Task {
+      const auto start = std::chrono::steady_clock::now();
+      while (std::chrono::steady_clock::now() - start < 300us)
+         ;
+      co_await stdcr::suspend_never{};
+      finished = true;
+   };
+
+   auto task = Busy(finished);
+   task.Run(dispatcher.GetExecutor());
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_TRUE(finished);
+}
+
+} // namespace
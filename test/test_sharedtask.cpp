@@ -0,0 +1,182 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/detachedhandle.hpp"
+#include "crhandle/sharedtask.hpp"
+#include "dispatcher.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct SharedTaskFixture : public ::testing::Test
+{
+   using StepwiseTask = cr::TaskHandle<void, ManualDispatcher::Executor>;
+   using StepwiseShared = cr::SharedTask<std::string, ManualDispatcher::Executor>;
+
+   static cr::TaskHandle<std::string, ManualDispatcher::Executor> Fetch(int & runs)
+   {
+      ++runs;
+      co_return "config";
+   }
+
+   static StepwiseTask Await(StepwiseShared shared, std::vector<const std::string *> & results)
+   {
+      const std::string & value = co_await shared.Get();
+      results.push_back(&value);
+   }
+
+   ManualDispatcher dispatcher;
+};
+
+TEST_F(SharedTaskFixture, shared_task_runs_once_for_all_awaiters)
+{
+   int runs = 0;
+   StepwiseShared shared(Fetch(runs), dispatcher.GetExecutor());
+   std::vector<const std::string *> results;
+   EXPECT_EQ(0, runs);
+
+   auto t1 = Await(shared, results);
+   auto t2 = Await(shared, results);
+   auto t3 = Await(shared, results);
+   t1.Run(dispatcher.GetExecutor());
+   t2.Run(dispatcher.GetExecutor());
+   t3.Run(dispatcher.GetExecutor());
+   EXPECT_FALSE(shared.Done());
+
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(shared.Done());
+   EXPECT_EQ(1, runs);
+   ASSERT_EQ(3u, results.size());
+   EXPECT_EQ("config", *results[0]);
+   EXPECT_EQ(results[0], results[1]);
+   EXPECT_EQ(results[0], results[2]);
+   EXPECT_FALSE(t1);
+   EXPECT_FALSE(t2);
+   EXPECT_FALSE(t3);
+}
+
+TEST_F(SharedTaskFixture, shared_task_resumes_awaiters_through_their_own_executors)
+{
+   ManualDispatcher other;
+   int runs = 0;
+   StepwiseShared shared(Fetch(runs), dispatcher.GetExecutor());
+   std::vector<const std::string *> results;
+
+   auto t1 = Await(shared, results);
+   auto t2 = Await(shared, results);
+   t1.Run(dispatcher.GetExecutor());
+   t2.Run(other.GetExecutor());
+   other.ProcessAll();
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(shared.Done());
+   EXPECT_EQ(1u, results.size());
+   EXPECT_TRUE(t2);
+
+   EXPECT_TRUE(other.ProcessOneTask());
+   EXPECT_EQ(2u, results.size());
+   EXPECT_FALSE(t2);
+}
+
+TEST_F(SharedTaskFixture, shared_task_hands_out_cached_result_without_suspending)
+{
+   int runs = 0;
+   cr::SharedTask<int> shared([](int & runs) -> cr::TaskHandle<int> {
+      co_return ++runs;
+   }(runs));
+   std::vector<int> results;
+
+   auto Await = [](cr::SharedTask<int> shared, std::vector<int> & results) -> cr::TaskHandle<void> {
+      results.push_back(co_await shared.Get());
+   };
+   Await(shared, results).Run();
+   EXPECT_TRUE(shared.Done());
+   Await(shared, results).Run();
+   EXPECT_EQ(1, runs);
+   EXPECT_EQ((std::vector<int>{1, 1}), results);
+}
+
+TEST_F(SharedTaskFixture, shared_task_rethrows_to_every_awaiter)
+{
+   cr::SharedTask<void, ManualDispatcher::Executor> shared(
+      []() -> cr::TaskHandle<void, ManualDispatcher::Executor> {
+         throw std::runtime_error("failed");
+         co_return;
+      }(),
+      dispatcher.GetExecutor());
+   int failures = 0;
+
+   auto Await = [](auto shared, int & failures) -> StepwiseTask {
+      try {
+         co_await shared.Get();
+      }
+      catch (const std::runtime_error &) {
+         ++failures;
+      }
+   };
+   auto t1 = Await(shared, failures);
+   auto t2 = Await(shared, failures);
+   t1.Run(dispatcher.GetExecutor());
+   t2.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_EQ(2, failures);
+
+   auto t3 = Await(shared, failures);
+   t3.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_EQ(3, failures);
+}
+
+TEST_F(SharedTaskFixture, shared_task_completes_when_awaiter_is_canceled)
+{
+   int runs = 0;
+   StepwiseShared shared(Fetch(runs), dispatcher.GetExecutor());
+   std::vector<const std::string *> results;
+
+   auto t1 = Await(shared, results);
+   auto t2 = Await(shared, results);
+   t1.Run(dispatcher.GetExecutor());
+   t2.Run(dispatcher.GetExecutor());
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   t1 = {};
+
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(shared.Done());
+   EXPECT_EQ(1u, results.size());
+   EXPECT_FALSE(t2);
+}
+
+TEST_F(SharedTaskFixture, shared_task_can_be_awaited_from_detached_coroutine)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   };
+   struct Awaitable
+   {
+      State & state;
+      bool await_ready() { return false; }
+      void await_suspend(stdcr::coroutine_handle<> h) { state.handle = h; }
+      void await_resume() {}
+   };
+   State state;
+   cr::SharedTask<int> shared([](State & state) -> cr::TaskHandle<int> {
+      co_await Awaitable{state};
+      co_return 42;
+   }(state));
+   std::vector<int> results;
+
+   auto Await = [](cr::SharedTask<int> shared, std::vector<int> & results) -> cr::DetachedHandle {
+      results.push_back(co_await shared.Get());
+   };
+   Await(shared, results);
+   Await(shared, results);
+   EXPECT_TRUE(results.empty());
+
+   state.handle.resume();
+   EXPECT_EQ((std::vector<int>{42, 42}), results);
+}
+
+} // namespace
@@ -0,0 +1,170 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "allocations.hpp"
+#include "counter.hpp"
+#include "crhandle/detachedhandle.hpp"
+#include "crhandle/spawn.hpp"
+#include "dispatcher.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct SpawnFixture : public ::testing::Test
+{
+   using StepwiseTask = cr::TaskHandle<void, ManualDispatcher::Executor>;
+
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   };
+   struct Awaitable
+   {
+      State & state;
+      bool await_ready() { return false; }
+      void await_suspend(stdcr::coroutine_handle<> h) { state.handle = h; }
+      void await_resume() {}
+   };
+
+   std::vector<std::string> errors;
+   cr::SpawnGroup group{[this](std::exception_ptr e) {
+      try {
+         std::rethrow_exception(e);
+      }
+      catch (const std::exception & ex) {
+         errors.emplace_back(ex.what());
+      }
+   }};
+};
+
+TEST_F(SpawnFixture, spawned_task_is_posted_and_tracked_until_done)
+{
+   ManualDispatcher dispatcher;
+   State state;
+   int count = 0;
+   bool done = false;
+
+   static auto Task = [](State & s, Counter counter, bool & done) -> StepwiseTask {
+      (void)counter;
+      co_await Awaitable{s};
+      done = true;
+   };
+
+   group.Spawn(dispatcher.GetExecutor(), [&, counter = Counter(count)] {
+      return Task(state, counter, done);
+   });
+   EXPECT_EQ(1u, group.Outstanding());
+   EXPECT_FALSE(state.handle);
+
+   dispatcher.ProcessAll();
+   ASSERT_TRUE(state.handle);
+   EXPECT_EQ(1u, group.Outstanding());
+
+   state.handle.resume();
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(done);
+   EXPECT_EQ(0u, group.Outstanding());
+   EXPECT_EQ(0, count);
+   EXPECT_TRUE(errors.empty());
+}
+
+TEST_F(SpawnFixture, idle_waiter_is_resumed_when_last_task_finishes)
+{
+   State state1;
+   State state2;
+   bool idle = false;
+
+   static auto Task = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable{s};
+   };
+   auto WaitIdle = [&]() -> cr::DetachedHandle {
+      co_await group.WhenIdle();
+      idle = true;
+   };
+
+   WaitIdle();
+   EXPECT_TRUE(idle);
+   idle = false;
+
+   group.Spawn(cr::InlineExecutor{}, [&] {
+      return Task(state1);
+   });
+   group.Spawn(cr::InlineExecutor{}, [&] {
+      return Task(state2);
+   });
+   EXPECT_EQ(2u, group.Outstanding());
+
+   WaitIdle();
+   EXPECT_FALSE(idle);
+
+   state2.handle.resume();
+   EXPECT_FALSE(idle);
+   EXPECT_EQ(1u, group.Outstanding());
+
+   state1.handle.resume();
+   EXPECT_TRUE(idle);
+   EXPECT_EQ(0u, group.Outstanding());
+}
+
+TEST_F(SpawnFixture, exceptions_are_routed_to_handler)
+{
+   State state;
+
+   static auto Failing = [](State & s) -> cr::TaskHandle<int> {
+      co_await Awaitable{s};
+      throw std::runtime_error("async failure");
+   };
+
+   group.Spawn(cr::InlineExecutor{}, [&] {
+      return Failing(state);
+   });
+   group.Spawn(cr::InlineExecutor{}, []() -> cr::TaskHandle<void> {
+      throw std::runtime_error("sync failure");
+   });
+   EXPECT_EQ((std::vector<std::string>{"sync failure"}), errors);
+   EXPECT_EQ(1u, group.Outstanding());
+
+   EXPECT_NO_THROW(state.handle.resume());
+   EXPECT_EQ((std::vector<std::string>{"sync failure", "async failure"}), errors);
+   EXPECT_EQ(0u, group.Outstanding());
+}
+
+TEST_F(SpawnFixture, spawning_in_steady_state_reuses_root_frames)
+{
+   static auto Task = [](int & sum, int value) -> cr::TaskHandle<void> {
+      sum += value;
+      co_return;
+   };
+
+   int sum = 0;
+   auto SpawnOne = [&](int value) {
+      group.Spawn(cr::InlineExecutor{}, [&sum, value] {
+         return Task(sum, value);
+      });
+   };
+
+   SpawnOne(0);
+   const auto allocationsBefore = AllocationCount();
+   for (int i = 1; i <= 1000; ++i)
+      SpawnOne(i);
+   // the spawned root frames are recycled, at most the frames of the tasks themselves are not
+   EXPECT_GE(1000u, AllocationCount() - allocationsBefore);
+   EXPECT_EQ(500500, sum);
+   EXPECT_EQ(0u, group.Outstanding());
+}
+
+TEST_F(SpawnFixture, free_spawn_uses_default_group)
+{
+   bool done = false;
+   cr::Spawn(cr::InlineExecutor{}, [&]() -> cr::TaskHandle<void> {
+      done = true;
+      co_return;
+   });
+   EXPECT_TRUE(done);
+   EXPECT_EQ(0u, cr::SpawnGroup::Default().Outstanding());
+}
+
+} // namespace
@@ -0,0 +1,141 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/strand.hpp"
+#include "crhandle/taskowner.hpp"
+#include "crhandle/unichannel.hpp"
+#include "dispatcher.hpp"
+#include "threadpool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct StrandFixture : public ::testing::Test
+{
+   using StepwiseStrand = cr::Strand<ManualDispatcher::Executor>;
+   using PoolStrand = cr::Strand<ThreadPool::Executor>;
+
+   ManualDispatcher dispatcher;
+};
+
+TEST_F(StrandFixture, strand_schedules_one_drain_for_many_posts)
+{
+   StepwiseStrand strand(dispatcher.GetExecutor());
+   std::vector<int> order;
+
+   for (int i = 0; i < 3; ++i)
+      strand.Execute([&order, i] { order.push_back(i); });
+   EXPECT_EQ(1u, dispatcher.queue.size());
+
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ((std::vector<int>{0, 1, 2}), order);
+   EXPECT_TRUE(dispatcher.queue.empty());
+
+   strand.Execute([&order] { order.push_back(3); });
+   EXPECT_EQ(1u, dispatcher.queue.size());
+   dispatcher.ProcessAll();
+   EXPECT_EQ((std::vector<int>{0, 1, 2, 3}), order);
+}
+
+TEST_F(StrandFixture, strand_yields_to_underlying_executor_after_max_batch)
+{
+   StepwiseStrand strand(dispatcher.GetExecutor());
+   std::size_t ran = 0;
+
+   for (std::size_t i = 0; i < StepwiseStrand::MaxBatch + 1; ++i)
+      strand.Execute([&ran] { ++ran; });
+   dispatcher.GetExecutor().Execute([] {});
+
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(StepwiseStrand::MaxBatch, ran);
+   EXPECT_EQ(2u, dispatcher.queue.size());
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(StepwiseStrand::MaxBatch + 1, ran);
+}
+
+TEST_F(StrandFixture, strand_dispatches_in_place_only_from_its_own_tasks)
+{
+   StepwiseStrand strand(dispatcher.GetExecutor());
+   StepwiseStrand other(dispatcher.GetExecutor());
+   std::vector<int> order;
+
+   EXPECT_FALSE(strand.RunningInThisThread());
+   strand.Execute([&] {
+      EXPECT_TRUE(strand.RunningInThisThread());
+      EXPECT_FALSE(other.RunningInThisThread());
+      cr::Dispatch(strand, [&] { order.push_back(1); });
+      cr::Dispatch(other, [&] { order.push_back(3); });
+      order.push_back(2);
+   });
+   dispatcher.ProcessAll();
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), order);
+   EXPECT_FALSE(strand.RunningInThisThread());
+}
+
+TEST_F(StrandFixture, strand_runs_tasks_on_thread_pool_one_at_a_time)
+{
+   constexpr int Posters = 4;
+   constexpr int PostsEach = 2000;
+   int counter = 0; // deliberately not atomic, only touched on the strand
+   std::atomic<int> inside = 0;
+   std::atomic<bool> overlapped = false;
+   std::atomic<int> finished = 0;
+   ThreadPool pool(4);
+   PoolStrand strand(pool.GetExecutor());
+
+   std::vector<std::thread> posters;
+   for (int p = 0; p < Posters; ++p) {
+      posters.emplace_back([&] {
+         for (int i = 0; i < PostsEach; ++i) {
+            strand.Execute([&] {
+               if (inside.fetch_add(1) != 0)
+                  overlapped = true;
+               ++counter;
+               inside.fetch_sub(1);
+               if (counter == Posters * PostsEach) {
+                  finished = 1;
+                  finished.notify_one();
+               }
+            });
+         }
+      });
+   }
+   for (auto & t : posters)
+      t.join();
+
+   finished.wait(0);
+   EXPECT_FALSE(overlapped);
+   EXPECT_EQ(Posters * PostsEach, counter);
+}
+
+TEST_F(StrandFixture, strand_drives_task_owner_and_unichannel)
+{
+   using Task = cr::TaskHandle<void, StepwiseStrand>;
+   using Channel = cr::Unichannel<int, StepwiseStrand>;
+
+   StepwiseStrand strand(dispatcher.GetExecutor());
+   auto channel = Channel::Make(strand);
+   Channel::Producer producer(channel);
+   std::vector<int> received;
+
+   static auto Consume = [](Channel & channel, std::vector<int> & out) -> Task {
+      while (auto item = co_await channel.Receive())
+         out.push_back(*item);
+   };
+
+   cr::TaskOwner<StepwiseStrand> owner(strand);
+   owner.StartRootTask(Consume(*channel, received));
+   producer.Send(1);
+   producer.Send(2);
+   producer.Close();
+   dispatcher.ProcessAll();
+   EXPECT_EQ((std::vector<int>{1, 2}), received);
+   EXPECT_NO_THROW(owner.RethrowExceptions());
+}
+
+} // namespace
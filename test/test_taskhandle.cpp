@@ -1,16 +1,30 @@
 #undef NDEBUG
 #include <gtest/gtest.h>
 
+#include "allocations.hpp"
 #include "counter.hpp"
 #include "crhandle/detachedhandle.hpp"
 #include "crhandle/taskhandle.hpp"
 #include "dispatcher.hpp"
 
+#include <array>
 #include <deque>
 #include <optional>
+#include <vector>
 
 namespace {
 
+struct PointerExecutor
+{
+   void * state = nullptr;
+
+   template <typename F>
+   void Execute(F && f)
+   {
+      std::invoke(std::forward<F>(f));
+   }
+};
+
 struct DetachedTaskFixture : public ::testing::Test
 {
    struct State
@@ -639,6 +653,23 @@ TEST_F(TaskHandleFixture, eager_task_resumes_its_continuation)
    EXPECT_EQ(42, value);
 }
 
+TEST_F(TaskHandleFixture, task_may_relocate_its_own_handle_while_running)
+{
+   std::vector<cr::TaskHandle<void>> tasks;
+
+   static auto GrowingTask = [](std::vector<cr::TaskHandle<void>> & tasks) -> cr::TaskHandle<void> {
+      // moves the vector's storage, including the handle Run() was called on
+      for (int i = 0; i < 16; ++i)
+         tasks.emplace_back();
+      co_return;
+   };
+
+   tasks.push_back(GrowingTask(tasks));
+   tasks.front().Run();
+   EXPECT_EQ(17u, tasks.size());
+   EXPECT_FALSE(tasks.front());
+}
+
 TEST_F(TaskHandleFixture, nested_lazy_tasks_can_be_canceled_top_down)
 {
    using TaskType = cr::TaskHandle<void, ::ManualDispatcher::Executor>;
@@ -702,4 +733,195 @@ TEST_F(TaskHandleFixture, nested_eager_tasks_can_be_canceled_top_down)
    EXPECT_FALSE(task);
 }
 
+TEST_F(TaskHandleFixture, stateless_executor_and_cancelation_flag_take_no_extra_space)
+{
+#ifndef _MSC_VER
+   using StatelessPromise = cr::internal::Promise<void, cr::InlineExecutor>;
+   using StatefulPromise = cr::internal::Promise<void, PointerExecutor>;
+
+   // variant (packed with the cancelation and context flags), parentLink, parentHandle
+   static_assert(sizeof(StatelessPromise) == 4 * sizeof(void *));
+   static_assert(sizeof(StatefulPromise) == sizeof(StatelessPromise) + sizeof(void *));
+#endif
+}
+
+TEST_F(TaskHandleFixture, frame_stats_track_frame_size_and_lifetime)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   } state;
+
+   static auto SmallTask = []() -> cr::TaskHandle<int> {
+      co_return 42;
+   };
+   static auto LargeTask = [](State & s) -> cr::TaskHandle<int> {
+      std::array<char, 1024> buffer{};
+      co_await Awaitable<State>{s};
+      co_return buffer.back();
+   };
+
+   const cr::FrameStats & stats = cr::ThreadFrameStats();
+   const cr::FrameStats before = stats;
+
+   auto small = SmallTask();
+   EXPECT_EQ(before.allocatedFrames + 1, stats.allocatedFrames);
+   EXPECT_EQ(before.liveFrames + 1, stats.liveFrames);
+   const size_t smallSize = stats.lastFrameSize;
+   EXPECT_LT(sizeof(cr::internal::Promise<int, cr::InlineExecutor>), smallSize);
+
+   auto large = LargeTask(state);
+   EXPECT_EQ(before.liveFrames + 2, stats.liveFrames);
+   EXPECT_LE(smallSize + 1024, stats.lastFrameSize);
+   EXPECT_EQ(static_cast<ptrdiff_t>(smallSize + stats.lastFrameSize),
+             stats.liveBytes - before.liveBytes);
+
+   small.Run();
+   EXPECT_FALSE(small);
+   small = {};
+   EXPECT_EQ(before.liveFrames + 1, stats.liveFrames);
+
+   large.Run();
+   EXPECT_TRUE(large);
+   state.handle.resume();
+   EXPECT_FALSE(large);
+   large = {};
+   EXPECT_EQ(before.liveFrames, stats.liveFrames);
+   EXPECT_EQ(before.liveBytes, stats.liveBytes);
+}
+
+TEST_F(TaskHandleFixture, frame_cache_reuses_freed_frames_of_the_same_bucket)
+{
+   using Cache = cr::internal::FrameCache;
+   Cache cache;
+
+   void * small = cache.Allocate(40);
+   void * large = cache.Allocate(Cache::Granularity * Cache::BucketCount + 1);
+   cache.Deallocate(small, 40);
+   cache.Deallocate(large, Cache::Granularity * Cache::BucketCount + 1);
+
+   // any size covered by the bucket gets the freed frame back, frames too large aren't kept
+   const size_t allocationsBefore = AllocationCount();
+   void * reused = cache.Allocate(Cache::Granularity);
+   EXPECT_EQ(small, reused);
+   EXPECT_EQ(allocationsBefore, AllocationCount());
+
+   void * fresh = cache.Allocate(Cache::Granularity + 1);
+   EXPECT_EQ(allocationsBefore + 1, AllocationCount());
+
+   cache.Deallocate(reused, Cache::Granularity);
+   cache.Deallocate(fresh, Cache::Granularity + 1);
+}
+
+TEST_F(TaskHandleFixture, nested_inline_tasks_dont_allocate_in_steady_state)
+{
+#ifndef CRHANDLE_FRAME_CACHE
+   // GCC never elides the frames of nested tasks, so without the cache each one is allocated
+   GTEST_SKIP() << "needs -Dcrhandle_frame_cache=ON";
+#else
+   static auto InnerIntTask = [](int i) -> cr::TaskHandle<int> {
+      co_return i;
+   };
+   static auto MiddleIntTask = [](int i) -> cr::TaskHandle<int> {
+      co_return co_await InnerIntTask(i) + 1;
+   };
+   static auto OuterIntTask = [](int count) -> cr::TaskHandle<int> {
+      int sum = 0;
+      for (int i = 0; i < count; ++i)
+         sum += co_await MiddleIntTask(i);
+      co_return sum;
+   };
+
+   // warm up the frame cache
+   EXPECT_EQ(1, OuterIntTask(1).Run().await_resume());
+
+   const size_t allocationsBefore = AllocationCount();
+   int result = 0;
+   {
+      auto task = OuterIntTask(10'000);
+      result = task.Run().await_resume();
+   }
+   const size_t allocations = AllocationCount() - allocationsBefore;
+
+   EXPECT_EQ(0u, allocations);
+   EXPECT_EQ(10'000 * 10'001 / 2, result);
+#endif
+}
+
+TEST_F(TaskHandleFixture, inline_task_canceled_while_awaiting_child_releases_all_frames)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      int count = 0;
+   } state;
+
+   static auto InnerVoidTask = [](State & s) -> cr::TaskHandle<void> {
+      Counter c(s.count);
+      co_await Awaitable<State>{s};
+   };
+   static auto OuterVoidTask = [](State & s) -> cr::TaskHandle<void> {
+      Counter c(s.count);
+      co_await InnerVoidTask(s);
+      ADD_FAILURE();
+   };
+
+   const cr::FrameStats & stats = cr::ThreadFrameStats();
+   const auto liveFramesBefore = stats.liveFrames;
+
+   auto task = OuterVoidTask(state);
+   task.Run();
+   EXPECT_EQ(2, state.count);
+   EXPECT_EQ(liveFramesBefore + 2, stats.liveFrames);
+
+   task = {};
+   state.handle.resume();
+   EXPECT_EQ(0, state.count);
+   EXPECT_EQ(liveFramesBefore, stats.liveFrames);
+}
+
+TEST_F(TaskHandleFixture, yield_reposts_task_behind_queued_work)
+{
+   using TaskType = cr::TaskHandle<void, ManualDispatcher::Executor>;
+   ManualDispatcher dispatcher;
+   std::vector<int> order;
+
+   static auto Task = [](int id, std::vector<int> & order) -> TaskType {
+      for (int i = 0; i < 3; ++i) {
+         order.push_back(id);
+         co_await cr::Yield();
+      }
+   };
+
+   auto task1 = Task(1, order);
+   task1.Run(ManualDispatcher::Executor{&dispatcher});
+   auto task2 = Task(2, order);
+   task2.Run(ManualDispatcher::Executor{&dispatcher});
+
+   while (dispatcher.ProcessOneTask())
+      ;
+   EXPECT_EQ((std::vector{1, 2, 1, 2, 1, 2}), order);
+   EXPECT_FALSE(task1);
+   EXPECT_FALSE(task2);
+}
+
+TEST_F(TaskHandleFixture, yield_is_noop_without_queue)
+{
+   bool done = false;
+   static auto Task = [](bool & done) -> cr::TaskHandle<void> {
+      co_await cr::Yield();
+      done = true;
+   };
+   auto task = Task(done);
+   task.Run();
+   EXPECT_TRUE(done);
+
+   done = false;
+   [&]() -> cr::DetachedHandle {
+      co_await cr::Yield();
+      done = true;
+   }();
+   EXPECT_TRUE(done);
+}
+
 } // namespace
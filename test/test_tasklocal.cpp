@@ -0,0 +1,188 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/tasklocal.hpp"
+#include "crhandle/taskutils.hpp"
+#include "dispatcher.hpp"
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+namespace {
+
+struct TaskLocalFixture : public ::testing::Test
+{
+   static inline const cr::TaskLocal<std::string> s_requestId;
+   static inline const cr::TaskLocal<int> s_tenant;
+
+   using Task = cr::TaskHandle<void>;
+   using StepwiseTask = cr::TaskHandle<void, ManualDispatcher::Executor>;
+
+   static std::optional<std::string> Read(const std::string * value)
+   {
+      return value ? std::optional<std::string>(*value) : std::nullopt;
+   }
+
+   struct Park
+   {
+      stdcr::coroutine_handle<> & handle;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(stdcr::coroutine_handle<> h) noexcept { handle = h; }
+      void await_resume() const noexcept {}
+   };
+};
+
+TEST_F(TaskLocalFixture, unbound_local_reads_as_null)
+{
+   const std::string dummy;
+   const std::string * value = &dummy;
+   static auto Reader = [](const std::string *& out) -> Task {
+      out = co_await s_requestId.Get();
+   };
+   auto task = Reader(value);
+   task.Run();
+   EXPECT_EQ(nullptr, value);
+}
+
+TEST_F(TaskLocalFixture, bound_local_is_visible_in_nested_tasks_until_unbound)
+{
+   std::optional<std::string> inner;
+   std::optional<std::string> innermost;
+   std::optional<std::string> afterUnbind;
+   const int * tenant = nullptr;
+
+   static auto Innermost = [](std::optional<std::string> & out, const int *& tenant) -> Task {
+      out = Read(co_await s_requestId.Get());
+      tenant = co_await s_tenant.Get();
+   };
+   static auto Inner = [](std::optional<std::string> & out,
+                          std::optional<std::string> & innermost,
+                          const int *& tenant) -> Task {
+      out = Read(co_await s_requestId.Get());
+      co_await Innermost(innermost, tenant);
+   };
+   auto Outer = [&]() -> Task {
+      {
+         auto binding = co_await s_requestId.Bind("req-1");
+         co_await Inner(inner, innermost, tenant);
+      }
+      afterUnbind = Read(co_await s_requestId.Get());
+   };
+
+   auto task = Outer();
+   task.Run();
+   EXPECT_FALSE(task);
+   EXPECT_EQ("req-1", inner);
+   EXPECT_EQ("req-1", innermost);
+   EXPECT_EQ(nullptr, tenant);
+   EXPECT_FALSE(afterUnbind.has_value());
+}
+
+TEST_F(TaskLocalFixture, child_bindings_shadow_parent_and_dont_leak_back)
+{
+   std::optional<std::string> childSees;
+   std::optional<std::string> parentSees;
+   std::optional<int> tenantSeen;
+
+   static auto Child = [](std::optional<std::string> & out, std::optional<int> & tenant) -> Task {
+      auto binding = co_await s_requestId.Bind("req-2");
+      out = Read(co_await s_requestId.Get());
+      if (const int * t = co_await s_tenant.Get())
+         tenant = *t;
+   };
+   auto Parent = [&]() -> Task {
+      auto tenantBinding = co_await s_tenant.Bind(7);
+      auto binding = co_await s_requestId.Bind("req-1");
+      co_await Child(childSees, tenantSeen);
+      parentSees = Read(co_await s_requestId.Get());
+   };
+
+   auto task = Parent();
+   task.Run();
+   EXPECT_EQ("req-2", childSees);
+   EXPECT_EQ(7, tenantSeen);
+   EXPECT_EQ("req-1", parentSees);
+}
+
+TEST_F(TaskLocalFixture, locals_are_inherited_across_executor_hops_and_combinators)
+{
+   ManualDispatcher dispatcher;
+   std::optional<std::string> first;
+   std::optional<std::string> second;
+
+   static auto Reader = [](std::optional<std::string> & out) -> StepwiseTask {
+      co_await cr::Yield();
+      out = Read(co_await s_requestId.Get());
+   };
+   static auto Outer = [](std::optional<std::string> & first,
+                          std::optional<std::string> & second) -> StepwiseTask {
+      auto binding = co_await s_requestId.Bind("req-3");
+      co_await cr::AllOf(Reader(first), Reader(second));
+   };
+
+   auto task = Outer(first, second);
+   task.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_FALSE(task);
+   EXPECT_EQ("req-3", first);
+   EXPECT_EQ("req-3", second);
+}
+
+TEST_F(TaskLocalFixture, tasks_inside_a_binding_see_cancelation_of_the_root)
+{
+   stdcr::coroutine_handle<> parked = nullptr;
+   bool resumed = false;
+
+   static auto Inner = [](stdcr::coroutine_handle<> & parked, bool & resumed) -> Task {
+      co_await Park{parked};
+      resumed = true;
+   };
+   static auto Outer = [](stdcr::coroutine_handle<> & parked, bool & resumed) -> Task {
+      auto binding = co_await s_requestId.Bind("req-4");
+      co_await Inner(parked, resumed);
+   };
+
+   auto task = Outer(parked, resumed);
+   task.Run();
+   ASSERT_TRUE(parked);
+
+   task = {};
+   parked.resume();
+   EXPECT_FALSE(resumed);
+}
+
+TEST_F(TaskLocalFixture, locals_reach_tasks_under_anyof_and_withdeadline)
+{
+   cr::TimerQueue<std::chrono::steady_clock> timers;
+   std::optional<std::string> winner;
+   std::optional<std::string> timed;
+   stdcr::coroutine_handle<> parked = nullptr;
+
+   static auto Reader = [](std::optional<std::string> & out) -> Task {
+      out = Read(co_await s_requestId.Get());
+   };
+   static auto Parked = [](stdcr::coroutine_handle<> & parked) -> Task {
+      co_await Park{parked};
+   };
+   auto Outer = [&]() -> Task {
+      auto binding = co_await s_requestId.Bind("req-5");
+      co_await cr::AnyOf(Parked(parked), Reader(winner));
+      co_await cr::WithDeadline(
+         timers, Reader(timed), std::chrono::steady_clock::now() + std::chrono::hours(1));
+   };
+
+   auto task = Outer();
+   task.Run();
+   EXPECT_FALSE(task);
+   EXPECT_EQ("req-5", winner);
+   EXPECT_EQ("req-5", timed);
+
+   // the loser of AnyOf() has been canceled and unwinds without touching the binding
+   ASSERT_TRUE(parked);
+   task = {};
+   parked.resume();
+}
+
+} // namespace
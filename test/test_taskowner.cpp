@@ -5,6 +5,7 @@
 #include "crhandle/taskowner.hpp"
 
 #include <optional>
+#include <vector>
 
 namespace {
 
@@ -50,6 +51,35 @@ TEST_F(TaskOwnerFixture, task_owner_starts_a_task)
    EXPECT_TRUE(state.handle.done());
 }
 
+TEST_F(TaskOwnerFixture, task_owner_starts_several_tasks_at_once)
+{
+   struct State
+   {
+      bool afterSuspend = false;
+      stdcr::coroutine_handle<> handle = nullptr;
+   } state1, state2;
+
+   static auto VoidTask = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+      s.afterSuspend = true;
+   };
+
+   cr::TaskOwner<> owner;
+   std::vector<cr::TaskHandle<void>> tasks;
+   tasks.push_back(VoidTask(state1));
+   tasks.push_back(VoidTask(state2));
+   owner.StartRootTasks(tasks);
+   EXPECT_FALSE(tasks[0]);
+   EXPECT_FALSE(tasks[1]);
+   EXPECT_TRUE(state1.handle);
+   EXPECT_TRUE(state2.handle);
+
+   state2.handle.resume();
+   state1.handle.resume();
+   EXPECT_TRUE(state1.afterSuspend);
+   EXPECT_TRUE(state2.afterSuspend);
+}
+
 TEST_F(TaskOwnerFixture, task_owner_cancels_tasks_when_dies)
 {
    struct State
@@ -7,10 +7,14 @@
 #include "crhandle/taskutils.hpp"
 #include "dispatcher.hpp"
 
+#include <chrono>
 #include <optional>
+#include <stdexcept>
 
 namespace {
 
+using namespace std::chrono_literals;
+
 struct TaskUtilsFixture : public ::testing::Test
 {
    template <typename S>
@@ -402,6 +406,31 @@ TEST_F(TaskUtilsFixture, allof_uses_provided_executor_instance)
    EXPECT_TRUE(result);
 }
 
+TEST_F(TaskUtilsFixture, allof_launches_children_with_one_batch)
+{
+   ManualDispatcher dispatcher;
+   using Task = cr::TaskHandle<int, ManualDispatcher::Executor>;
+
+   std::optional<std::tuple<int, int, int>> result;
+
+   static auto IntTask = [](int value) -> Task {
+      co_return value;
+   };
+   static auto OuterTask = [](auto & result) -> cr::TaskHandle<void, ManualDispatcher::Executor> {
+      result.emplace(co_await cr::AllOf(IntTask(1), IntTask(2), IntTask(3)));
+   };
+
+   auto handle = OuterTask(result);
+   handle.Run(dispatcher.GetExecutor());
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(1u, dispatcher.batches);
+   EXPECT_EQ(3u, dispatcher.queue.size());
+
+   dispatcher.ProcessAll();
+   EXPECT_EQ(std::make_tuple(1, 2, 3), result);
+}
+
 TEST_F(TaskUtilsFixture, allof_cancelation_doesnt_leak_memory)
 {
    ManualDispatcher dispatcher;
@@ -448,4 +477,363 @@ TEST_F(TaskUtilsFixture, allof_cancelation_doesnt_leak_memory)
    EXPECT_EQ(0, count);
 }
 
+TEST_F(TaskUtilsFixture, allof_rethrows_first_failure_and_cancels_other_tasks)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool done = false;
+   } state1, state2;
+
+   static auto FailingTask = [](State & s) -> cr::TaskHandle<int> {
+      co_await Awaitable<State>{s};
+      throw std::runtime_error("failure");
+   };
+   static auto VoidTask = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+      s.done = true;
+   };
+
+   bool failed = false;
+   bool finished = false;
+
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      try {
+         co_await cr::AllOf(FailingTask(state1), VoidTask(state2));
+         finished = true;
+      }
+      catch (const std::runtime_error &) {
+         failed = true;
+      }
+   };
+
+   OuterTask();
+   EXPECT_TRUE(state1.handle);
+   EXPECT_TRUE(state2.handle);
+   EXPECT_FALSE(failed);
+
+   state1.handle.resume();
+   EXPECT_TRUE(failed);
+   EXPECT_FALSE(finished);
+
+   state2.handle.resume();
+   EXPECT_FALSE(state2.done);
+   EXPECT_FALSE(finished);
+}
+
+TEST_F(TaskUtilsFixture, allof_handles_immediate_failure_and_short_circuits)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool done = false;
+   } state;
+
+   static auto FailingTask = []() -> cr::TaskHandle<void> {
+      throw std::runtime_error("failure");
+      co_return;
+   };
+   static auto IntegerTask = [](State & s) -> cr::TaskHandle<int> {
+      co_await Awaitable<State>{s};
+      s.done = true;
+      co_return 42;
+   };
+
+   bool failed = false;
+
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      try {
+         co_await cr::AllOf(FailingTask(), IntegerTask(state));
+      }
+      catch (const std::runtime_error &) {
+         failed = true;
+      }
+   };
+
+   OuterTask();
+   EXPECT_TRUE(failed);
+   EXPECT_FALSE(state.handle);
+   EXPECT_FALSE(state.done);
+}
+
+TEST_F(TaskUtilsFixture, allof_failure_doesnt_leak_memory)
+{
+   ManualDispatcher dispatcher;
+
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool done = false;
+   } state1, state2;
+
+   int count = 0;
+   bool failed = false;
+
+   using Task = cr::TaskHandle<void, ManualDispatcher::Executor>;
+   static auto FailingTask = [](State & s, Counter counter) -> Task {
+      (void)counter;
+      co_await Awaitable<State>{s};
+      throw std::runtime_error("failure");
+   };
+   static auto VoidTask = [](State & s, Counter counter) -> Task {
+      (void)counter;
+      co_await Awaitable<State>{s};
+      s.done = true;
+   };
+   static auto OuterTask =
+      [](State & state1, State & state2, Counter counter, bool & failed) -> Task {
+      try {
+         co_await cr::AllOf(FailingTask(state1, counter), VoidTask(state2, counter));
+      }
+      catch (const std::runtime_error &) {
+         failed = true;
+      }
+   };
+
+   auto handle = OuterTask(state1, state2, Counter(count), failed);
+   handle.Run(ManualDispatcher::Executor{&dispatcher});
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(state1.handle);
+   EXPECT_TRUE(state2.handle);
+   EXPECT_LE(3, count);
+
+   state1.handle.resume();
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(failed);
+   EXPECT_FALSE(handle);
+
+   handle = {};
+   state2.handle.resume();
+   dispatcher.ProcessAll();
+   EXPECT_FALSE(state2.done);
+   EXPECT_EQ(0, count);
+}
+
+TEST_F(TaskUtilsFixture, withdeadline_delivers_result_and_disarms_timer)
+{
+   cr::TimerQueue<std::chrono::steady_clock> timers;
+   const auto start = std::chrono::steady_clock::now();
+
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   } state;
+
+   static auto IntegerTask = [](State & s) -> cr::TaskHandle<int> {
+      co_await Awaitable<State>{s};
+      co_return 42;
+   };
+
+   std::optional<int> result;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      result = co_await cr::WithDeadline(timers, IntegerTask(state), start + 10ms);
+   };
+
+   OuterTask();
+   ASSERT_TRUE(state.handle);
+   EXPECT_FALSE(timers.Empty());
+
+   state.handle.resume();
+   EXPECT_EQ(42, result);
+   EXPECT_TRUE(timers.Empty());
+   EXPECT_EQ(0u, timers.FireExpired(start + 1s));
+}
+
+TEST_F(TaskUtilsFixture, withtimeout_doesnt_arm_timer_for_synchronous_task)
+{
+   cr::TimerQueue<std::chrono::steady_clock> timers;
+
+   static auto VoidTask = []() -> cr::TaskHandle<void> {
+      co_return;
+   };
+
+   bool done = false;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      co_await cr::WithTimeout(timers, VoidTask(), 10ms);
+      done = true;
+   };
+
+   OuterTask();
+   EXPECT_TRUE(done);
+   EXPECT_TRUE(timers.Empty());
+}
+
+TEST_F(TaskUtilsFixture, withdeadline_cancels_task_on_expiry)
+{
+   cr::TimerQueue<std::chrono::steady_clock> timers;
+   const auto start = std::chrono::steady_clock::now();
+
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool done = false;
+   } state;
+
+   static auto VoidTask = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+      s.done = true;
+   };
+
+   bool timedOut = false;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      try {
+         co_await cr::WithDeadline(timers, VoidTask(state), start + 10ms);
+      }
+      catch (const cr::TimeoutException &) {
+         timedOut = true;
+      }
+   };
+
+   OuterTask();
+   ASSERT_TRUE(state.handle);
+
+   EXPECT_EQ(0u, timers.FireExpired(start + 5ms));
+   EXPECT_FALSE(timedOut);
+   EXPECT_EQ(1u, timers.FireExpired(start + 10ms));
+   EXPECT_TRUE(timedOut);
+   EXPECT_TRUE(timers.Empty());
+
+   state.handle.resume();
+   EXPECT_FALSE(state.done);
+}
+
+TEST_F(TaskUtilsFixture, withdeadline_cancels_nested_tasks_that_outlive_it)
+{
+   cr::TimerQueue<std::chrono::steady_clock> timers;
+   const auto start = std::chrono::steady_clock::now();
+
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool grandchildDone = false;
+      bool childDone = false;
+   } state;
+
+   static auto Grandchild = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+      s.grandchildDone = true;
+   };
+   static auto Child = [](State & s) -> cr::TaskHandle<void> {
+      co_await Grandchild(s);
+      s.childDone = true;
+   };
+
+   auto root = cr::WithDeadline(timers, Child(state), start + 10ms);
+   root.Run();
+   ASSERT_TRUE(state.handle);
+
+   EXPECT_EQ(1u, timers.FireExpired(start + 10ms));
+   EXPECT_FALSE(root);
+   EXPECT_THROW(root.EnsureNoException(), cr::TimeoutException);
+
+   // the grandchild must not look at the flag of the destroyed root frame
+   root = {};
+   state.handle.resume();
+   EXPECT_FALSE(state.grandchildDone);
+   EXPECT_FALSE(state.childDone);
+}
+
+TEST_F(TaskUtilsFixture, withdeadline_task_is_canceled_with_the_awaiting_task)
+{
+   cr::TimerQueue<std::chrono::steady_clock> timers;
+   const auto start = std::chrono::steady_clock::now();
+
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool grandchildDone = false;
+      bool childDone = false;
+      bool outerDone = false;
+   } state;
+
+   static auto Grandchild = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+      s.grandchildDone = true;
+   };
+   static auto Child = [](State & s) -> cr::TaskHandle<void> {
+      co_await Grandchild(s);
+      s.childDone = true;
+   };
+   static auto Outer = [](cr::TimerQueue<std::chrono::steady_clock> & timers,
+                          std::chrono::steady_clock::time_point deadline,
+                          State & s) -> cr::TaskHandle<void> {
+      co_await cr::WithDeadline(timers, Child(s), deadline);
+      s.outerDone = true;
+   };
+
+   auto outer = Outer(timers, start + 10ms, state);
+   outer.Run();
+   ASSERT_TRUE(state.handle);
+   EXPECT_FALSE(timers.Empty());
+
+   outer = {};
+   state.handle.resume();
+   EXPECT_FALSE(state.grandchildDone);
+   EXPECT_FALSE(state.childDone);
+   EXPECT_FALSE(state.outerDone);
+   EXPECT_TRUE(timers.Empty());
+   EXPECT_EQ(0u, timers.FireExpired(start + 10ms));
+}
+
+TEST_F(TaskUtilsFixture, withdeadline_prefers_result_already_scheduled_and_doesnt_leak)
+{
+   ManualDispatcher dispatcher;
+   cr::TimerQueue<std::chrono::steady_clock> timers;
+   const auto start = std::chrono::steady_clock::now();
+
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   } state1, state2;
+
+   int count = 0;
+   std::optional<int> result;
+   bool timedOut = false;
+
+   using Task = cr::TaskHandle<void, ManualDispatcher::Executor>;
+   using IntTask = cr::TaskHandle<int, ManualDispatcher::Executor>;
+   static auto IntegerTask = [](State & s, Counter counter) -> IntTask {
+      (void)counter;
+      co_await Awaitable<State>{s};
+      co_return 42;
+   };
+   static auto OuterTask = [](cr::TimerQueue<std::chrono::steady_clock> & timers,
+                              std::chrono::steady_clock::time_point deadline,
+                              State & s,
+                              Counter counter,
+                              std::optional<int> & result,
+                              bool & timedOut) -> Task {
+      try {
+         result = co_await cr::WithDeadline(timers, IntegerTask(s, counter), deadline);
+      }
+      catch (const cr::TimeoutException &) {
+         timedOut = true;
+      }
+   };
+
+   auto finishing = OuterTask(timers, start + 10ms, state1, Counter(count), result, timedOut);
+   finishing.Run(dispatcher.GetExecutor());
+   auto expiring = OuterTask(timers, start + 20ms, state2, Counter(count), result, timedOut);
+   expiring.Run(dispatcher.GetExecutor());
+   dispatcher.ProcessAll();
+   ASSERT_TRUE(state1.handle);
+   ASSERT_TRUE(state2.handle);
+
+   state1.handle.resume();
+   // the frame the task is awaited in hands the result on
+   ASSERT_TRUE(dispatcher.ProcessOneTask());
+   EXPECT_EQ(2u, timers.FireExpired(start + 1s));
+   dispatcher.ProcessAll();
+   EXPECT_EQ(42, result);
+   EXPECT_TRUE(timedOut);
+   EXPECT_FALSE(finishing);
+   EXPECT_FALSE(expiring);
+
+   finishing = {};
+   expiring = {};
+   state2.handle.resume();
+   dispatcher.ProcessAll();
+   EXPECT_EQ(0, count);
+}
+
 } // namespace
@@ -0,0 +1,101 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/timerqueue.hpp"
+
+#include <chrono>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+struct TimerQueueFixture : public ::testing::Test
+{
+   using Queue = cr::TimerQueue<std::chrono::steady_clock>;
+
+   struct RecordingTimer : Queue::Timer
+   {
+      explicit RecordingTimer(int id, std::vector<int> & fired)
+         : Queue::Timer(&OnFire)
+         , id(id)
+         , fired(fired)
+      {}
+
+      static void OnFire(Queue::Timer & timer)
+      {
+         auto & self = static_cast<RecordingTimer &>(timer);
+         self.fired.push_back(self.id);
+      }
+
+      int id;
+      std::vector<int> & fired;
+   };
+
+   const Queue::TimePoint start = std::chrono::steady_clock::now();
+};
+
+TEST_F(TimerQueueFixture, timers_fire_in_deadline_order)
+{
+   Queue queue;
+   std::vector<int> fired;
+   RecordingTimer t1(1, fired);
+   RecordingTimer t2(2, fired);
+   RecordingTimer t3(3, fired);
+   RecordingTimer t4(4, fired);
+
+   queue.Arm(t3, start + 30ms);
+   queue.Arm(t1, start + 10ms);
+   queue.Arm(t4, start + 30ms);
+   queue.Arm(t2, start + 20ms);
+   EXPECT_EQ(start + 10ms, queue.NextDeadline());
+
+   EXPECT_EQ(0u, queue.FireExpired(start + 5ms));
+   EXPECT_EQ(2u, queue.FireExpired(start + 20ms));
+   EXPECT_EQ((std::vector<int>{1, 2}), fired);
+   EXPECT_FALSE(t1.Armed());
+   EXPECT_TRUE(t3.Armed());
+
+   EXPECT_EQ(2u, queue.FireExpired(start + 1s));
+   EXPECT_EQ((std::vector<int>{1, 2, 3, 4}), fired);
+   EXPECT_TRUE(queue.Empty());
+   EXPECT_FALSE(queue.NextDeadline().has_value());
+}
+
+TEST_F(TimerQueueFixture, disarmed_and_destroyed_timers_dont_fire)
+{
+   Queue queue;
+   std::vector<int> fired;
+   RecordingTimer t1(1, fired);
+   RecordingTimer t2(2, fired);
+   {
+      RecordingTimer t3(3, fired);
+      queue.Arm(t3, start + 10ms);
+      queue.Arm(t2, start + 20ms);
+      queue.Arm(t1, start + 30ms);
+   }
+   t2.Disarm();
+   t2.Disarm();
+   EXPECT_FALSE(t2.Armed());
+   EXPECT_EQ(start + 30ms, queue.NextDeadline());
+
+   queue.Arm(t1, start + 40ms);
+   EXPECT_EQ(0u, queue.FireExpired(start + 35ms));
+   EXPECT_EQ(1u, queue.FireExpired(start + 40ms));
+   EXPECT_EQ((std::vector<int>{1}), fired);
+}
+
+TEST_F(TimerQueueFixture, destroyed_queue_disarms_its_timers)
+{
+   std::vector<int> fired;
+   RecordingTimer t1(1, fired);
+   {
+      Queue queue;
+      queue.Arm(t1, start);
+      EXPECT_TRUE(t1.Armed());
+   }
+   EXPECT_FALSE(t1.Armed());
+   EXPECT_TRUE(fired.empty());
+}
+
+} // namespace
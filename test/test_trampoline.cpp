@@ -0,0 +1,143 @@
+#undef NDEBUG
+#include <gtest/gtest.h>
+
+#include "crhandle/detachedhandle.hpp"
+#include "crhandle/taskhandle.hpp"
+#include "crhandle/trampoline.hpp"
+#include "crhandle/unichannel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct TrampolineFixture : public ::testing::Test
+{
+   using Task = cr::TaskHandle<void, cr::TrampolineExecutor>;
+   using IntTask = cr::TaskHandle<int, cr::TrampolineExecutor>;
+   using Channel = cr::Unichannel<int, cr::TrampolineExecutor>;
+
+   // Generous even for sanitizer builds, the recursion below would need far more without the loop
+   static constexpr std::uintptr_t MaxStackUsage = 256 * 1024;
+
+   static std::uintptr_t StackAddress()
+   {
+      int local = 0;
+      return reinterpret_cast<std::uintptr_t>(&local);
+   }
+
+   static void RecordStack(std::uintptr_t & low, std::uintptr_t & high)
+   {
+      const std::uintptr_t here = StackAddress();
+      low = low ? std::min(low, here) : here;
+      high = std::max(high, here);
+   }
+
+   static IntTask Depth(int n, std::uintptr_t & low, std::uintptr_t & high)
+   {
+      RecordStack(low, high);
+      if (n == 0)
+         co_return 0;
+      co_return 1 + co_await Depth(n - 1, low, high);
+   }
+};
+
+TEST_F(TrampolineFixture, trampoline_runs_top_level_task_synchronously)
+{
+   int result = 0;
+   auto task = [](int & result) -> Task {
+      result = co_await []() -> IntTask { co_return 42; }();
+   }(result);
+   task.Run();
+   EXPECT_EQ(42, result);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(TrampolineFixture, trampoline_queues_work_posted_by_running_task)
+{
+   std::vector<int> order;
+   cr::TrampolineExecutor executor;
+
+   executor.Execute([&] {
+      EXPECT_TRUE(executor.RunningInThisThread());
+      executor.Execute([&] {
+         executor.Execute([&] { order.push_back(3); });
+         order.push_back(2);
+      });
+      order.push_back(1);
+   });
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), order);
+   EXPECT_FALSE(executor.RunningInThisThread());
+}
+
+TEST_F(TrampolineFixture, trampoline_drains_queue_before_rethrowing)
+{
+   std::vector<int> order;
+   cr::TrampolineExecutor executor;
+
+   auto task = [&] {
+      executor.Execute([&] { order.push_back(1); });
+      executor.Execute([&] {
+         order.push_back(2);
+         throw std::logic_error("second");
+      });
+      executor.Execute([&] { order.push_back(3); });
+      throw std::runtime_error("first");
+   };
+   EXPECT_THROW(executor.Execute(task), std::runtime_error);
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), order);
+   EXPECT_FALSE(executor.RunningInThisThread());
+
+   // nothing is left over for the next top-level call
+   executor.Execute([&] { order.push_back(4); });
+   EXPECT_EQ((std::vector<int>{1, 2, 3, 4}), order);
+}
+
+TEST_F(TrampolineFixture, trampoline_runs_deep_task_chain_in_bounded_stack)
+{
+   constexpr int Levels = 20'000;
+   std::uintptr_t low = 0;
+   std::uintptr_t high = 0;
+   int result = -1;
+
+   auto task = [](int & result, std::uintptr_t & low, std::uintptr_t & high) -> Task {
+      result = co_await Depth(Levels, low, high);
+   }(result, low, high);
+   task.Run();
+   EXPECT_EQ(Levels, result);
+   EXPECT_LT(high - low, MaxStackUsage);
+}
+
+TEST_F(TrampolineFixture, trampoline_runs_self_feeding_unichannel_consumer_in_bounded_stack)
+{
+   constexpr int Messages = 20'000;
+   auto channel = Channel::Make();
+   Channel::Producer producer(channel);
+   std::uintptr_t low = 0;
+   std::uintptr_t high = 0;
+   int received = 0;
+
+   auto consumer = [](Channel & channel,
+                      Channel::Producer & producer,
+                      int & received,
+                      std::uintptr_t & low,
+                      std::uintptr_t & high) -> Task {
+      while (true) {
+         const int item = co_await channel.Next();
+         RecordStack(low, high);
+         ++received;
+         if (item > 0)
+            producer.Send(item - 1);
+      }
+   }(*channel, producer, received, low, high);
+   consumer.Run();
+
+   producer.Send(Messages - 1);
+   EXPECT_EQ(Messages, received);
+   EXPECT_LT(high - low, MaxStackUsage);
+   EXPECT_TRUE(consumer);
+}
+
+} // namespace
@@ -6,7 +6,13 @@
 #include "dispatcher.hpp"
 
 #include <concepts>
+#include <iterator>
+#include <list>
+#include <optional>
+#include <span>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 namespace {
 
@@ -573,4 +579,456 @@ TEST_F(UnichannelFixture, unichannel_stepwise_all_canceled_consumers)
    EXPECT_FALSE(task3);
 }
 
+TEST_F(UnichannelFixture, unichannel_immediate_emplace_constructs_in_place)
+{
+   struct Counted
+   {
+      Counted(int v, int & moves)
+         : value(v)
+         , moves(&moves)
+      {}
+      Counted(Counted && other) noexcept
+         : value(other.value)
+         , moves(other.moves)
+      {
+         ++*moves;
+      }
+
+      int value;
+      int * moves;
+   };
+   auto ch = cr::Unichannel<Counted>::Make();
+   cr::Unichannel<Counted>::Producer prod(ch);
+   int moves = 0;
+
+   EXPECT_TRUE(prod.Emplace(42, moves));
+   EXPECT_EQ(0, moves);
+
+   int received = 0;
+   [](auto * ch, int & received) -> cr::DetachedHandle {
+      auto result = co_await ch->Next();
+      received = result.value;
+   }(ch.get(), received);
+   EXPECT_EQ(42, received);
+}
+
+TEST_F(UnichannelFixture, unichannel_stepwise_emplace_posts_arguments)
+{
+   auto ch = StepwiseChannel::Make(GetExecutor());
+   StepwiseChannel::Producer prod(ch);
+   std::vector<int> received;
+
+   EXPECT_TRUE(prod.Emplace(new int(42)));
+   EXPECT_EQ(1u, dispatcher.queue.size());
+
+   auto task = [](StepwiseChannel * ch,
+                  std::vector<int> & received) -> cr::TaskHandle<void, ManualDispatcher::Executor> {
+      auto result = co_await ch->Next();
+      received.push_back(*result);
+   }(ch.get(), received);
+   task.Run(GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_EQ((std::vector<int>{42}), received);
+   EXPECT_FALSE(task);
+
+   ch.reset();
+   EXPECT_FALSE(prod.Emplace(std::make_unique<int>(43)));
+   EXPECT_TRUE(dispatcher.queue.empty());
+}
+
+TEST_F(UnichannelFixture, unichannel_stepwise_send_batch_posts_one_task)
+{
+   auto ch = StepwiseChannel::Make(GetExecutor());
+   StepwiseChannel::Producer prod(ch);
+   std::vector<int> received;
+
+   std::vector<std::unique_ptr<int>> items;
+   for (int i = 0; i < 5; ++i)
+      items.push_back(std::make_unique<int>(i));
+
+   EXPECT_TRUE(prod.SendBatch(std::span(items)));
+   EXPECT_EQ(1u, dispatcher.queue.size());
+   for (const auto & item : items)
+      EXPECT_FALSE(item);
+
+   auto task = [](StepwiseChannel * ch,
+                  std::vector<int> & received) -> cr::TaskHandle<void, ManualDispatcher::Executor> {
+      for (int i = 0; i < 5; ++i) {
+         auto result = co_await ch->Next();
+         received.push_back(*result);
+      }
+   }(ch.get(), received);
+   task.Run(GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_EQ((std::vector<int>{0, 1, 2, 3, 4}), received);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(UnichannelFixture, unichannel_stepwise_send_batch_of_trivial_items)
+{
+   using Channel = cr::Unichannel<int, ManualDispatcher::Executor>;
+   auto ch = Channel::Make(GetExecutor());
+   Channel::Producer prod(ch);
+   std::vector<int> received;
+
+   std::vector<int> items{1, 2, 3};
+   EXPECT_TRUE(prod.SendBatch(std::span(items)));
+   items.assign({7, 7, 7});
+   EXPECT_TRUE(prod.SendBatch(std::span<int>()));
+   EXPECT_EQ(1u, dispatcher.queue.size());
+
+   auto task = [](Channel * ch,
+                  std::vector<int> & received) -> cr::TaskHandle<void, ManualDispatcher::Executor> {
+      for (int i = 0; i < 3; ++i)
+         received.push_back(co_await ch->Next());
+   }(ch.get(), received);
+   task.Run(GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), received);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(UnichannelFixture, unichannel_immediate_send_batch_from_range)
+{
+   using Channel = cr::Unichannel<std::string>;
+   auto ch = Channel::Make();
+   Channel::Producer prod(ch);
+   std::vector<std::string> received;
+
+   [](auto * ch, std::vector<std::string> & received) -> cr::DetachedHandle {
+      for (int i = 0; i < 4; ++i)
+         received.push_back(co_await ch->Next());
+   }(ch.get(), received);
+
+   const std::list<const char *> words{"a", "b", "c"};
+   EXPECT_TRUE(prod.SendBatch(words.begin(), words.end()));
+   EXPECT_EQ((std::vector<std::string>{"a", "b", "c"}), received);
+
+   std::string last[] = {"d"};
+   EXPECT_TRUE(prod.SendBatch(std::begin(last), std::end(last)));
+   EXPECT_EQ((std::vector<std::string>{"a", "b", "c", "d"}), received);
+   EXPECT_EQ("d", last[0]);
+}
+
+TEST_F(UnichannelFixture, unichannel_send_batch_from_range_copies_unless_asked_to_move)
+{
+   using Channel = cr::Unichannel<std::string>;
+   auto ch = Channel::Make();
+   Channel::Producer prod(ch);
+   std::vector<std::string> received;
+
+   [](auto * ch, std::vector<std::string> & received) -> cr::DetachedHandle {
+      for (int i = 0; i < 5; ++i)
+         received.push_back(co_await ch->Next());
+   }(ch.get(), received);
+
+   std::vector<std::string> contiguous{"a long enough string to be allocated", "b"};
+   std::list<std::string> linked{"c", "d"};
+   EXPECT_TRUE(prod.SendBatch(contiguous.begin(), contiguous.end()));
+   EXPECT_TRUE(prod.SendBatch(linked.begin(), linked.end()));
+   EXPECT_EQ(contiguous, std::vector<std::string>(received.begin(), received.begin() + 2));
+   EXPECT_EQ((std::list<std::string>{"c", "d"}), linked);
+
+   std::vector<std::string> moved{"e"};
+   EXPECT_TRUE(prod.SendBatch(std::make_move_iterator(moved.begin()),
+                              std::make_move_iterator(moved.end())));
+   EXPECT_EQ("e", received.back());
+   EXPECT_EQ(5u, received.size());
+}
+
+TEST_F(UnichannelFixture, unichannel_immediate_receive_drains_closed_channel)
+{
+   auto ch = ImmediateChannel::Make();
+   ImmediateChannel::Producer prod(ch);
+   std::vector<int> received;
+   bool done = false;
+
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(42)));
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(43)));
+   EXPECT_TRUE(prod.Close());
+   EXPECT_FALSE(prod.Close());
+   EXPECT_FALSE(prod.Send(std::make_unique<int>(44)));
+   EXPECT_FALSE(ImmediateChannel::Producer(ch).Emplace(std::make_unique<int>(45)));
+
+   [](auto * ch, std::vector<int> & received, bool & done) -> cr::DetachedHandle {
+      while (auto result = co_await ch->Receive())
+         received.push_back(**result);
+      EXPECT_FALSE(co_await ch->Receive());
+      EXPECT_THROW(co_await ch->Next(), cr::CanceledException);
+      done = true;
+   }(ch.get(), received, done);
+
+   EXPECT_TRUE(done);
+   EXPECT_EQ((std::vector<int>{42, 43}), received);
+}
+
+TEST_F(UnichannelFixture, unichannel_immediate_close_resumes_waiting_consumers)
+{
+   auto ch = ImmediateChannel::Make();
+   ImmediateChannel::Producer prod(ch);
+   int ended = 0;
+
+   auto Consume = [](auto * ch, int & ended) -> cr::DetachedHandle {
+      while (co_await ch->Receive())
+         ;
+      ++ended;
+   };
+   Consume(ch.get(), ended);
+   Consume(ch.get(), ended);
+   EXPECT_EQ(0, ended);
+
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(42)));
+   EXPECT_EQ(0, ended);
+
+   EXPECT_TRUE(prod.Close());
+   EXPECT_EQ(2, ended);
+}
+
+TEST_F(UnichannelFixture, unichannel_stepwise_close_is_ordered_after_sends)
+{
+   auto ch = StepwiseChannel::Make(GetExecutor());
+   StepwiseChannel::Producer prod(ch);
+   std::vector<int> received;
+   bool done = false;
+
+   auto task = [](StepwiseChannel * ch,
+                  std::vector<int> & received,
+                  bool & done) -> cr::TaskHandle<void, ManualDispatcher::Executor> {
+      while (auto result = co_await ch->Receive())
+         received.push_back(**result);
+      done = true;
+   }(ch.get(), received, done);
+   task.Run(GetExecutor());
+   dispatcher.ProcessAll();
+
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(42)));
+   EXPECT_TRUE(prod.Close());
+   EXPECT_FALSE(prod.Send(std::make_unique<int>(43)));
+   EXPECT_FALSE(done);
+
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(done);
+   EXPECT_EQ((std::vector<int>{42}), received);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(UnichannelFixture, unichannel_stepwise_delivers_sends_that_arrive_after_close)
+{
+   auto ch = StepwiseChannel::Make(GetExecutor());
+   StepwiseChannel::Producer prod(ch);
+   std::vector<int> received;
+   bool done = false;
+
+   auto task = [](StepwiseChannel * ch,
+                  std::vector<int> & received,
+                  bool & done) -> cr::TaskHandle<void, ManualDispatcher::Executor> {
+      while (auto result = co_await ch->Receive())
+         received.push_back(**result);
+      done = true;
+   }(ch.get(), received, done);
+   task.Run(GetExecutor());
+   dispatcher.ProcessAll();
+
+   // as on a multi-threaded executor, the close runs before the sends accepted ahead of it
+   EXPECT_TRUE(prod.Send(std::make_unique<int>(42)));
+   std::vector<std::unique_ptr<int>> batch;
+   batch.push_back(std::make_unique<int>(43));
+   EXPECT_TRUE(prod.SendBatch(std::span(batch)));
+   EXPECT_TRUE(prod.Close());
+   ASSERT_EQ(3u, dispatcher.queue.size());
+   auto close = std::move(dispatcher.queue.back());
+   dispatcher.queue.pop_back();
+   close();
+   EXPECT_FALSE(done);
+
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(done);
+   EXPECT_EQ((std::vector<int>{42, 43}), received);
+   EXPECT_FALSE(task);
+}
+
+TEST_F(UnichannelFixture, unichannel_immediate_receive_returns_nullopt_when_dies)
+{
+   auto ch = ImmediateChannel::Make();
+   bool done = false;
+
+   [](auto * ch, bool & done) -> cr::DetachedHandle {
+      EXPECT_FALSE(co_await ch->Receive());
+      done = true;
+   }(ch.get(), done);
+   EXPECT_FALSE(done);
+
+   ch.reset();
+   EXPECT_TRUE(done);
+}
+
+TEST_F(UnichannelFixture, select_immediate_takes_ready_item_in_argument_order)
+{
+   auto intCh = ImmediateChannel::Make();
+   auto strCh = cr::Unichannel<std::string>::Make();
+   ImmediateChannel::Producer intProd(intCh);
+   cr::Unichannel<std::string>::Producer strProd(strCh);
+
+   EXPECT_TRUE(strProd.Send("Hello World"));
+   EXPECT_TRUE(intProd.Send(std::make_unique<int>(42)));
+
+   std::vector<size_t> indices;
+   [](auto * intCh, auto * strCh, std::vector<size_t> & indices) -> cr::DetachedHandle {
+      auto first = co_await cr::Select(*intCh, *strCh);
+      EXPECT_EQ(42, *std::get<0>(first));
+      indices.push_back(first.index());
+      auto second = co_await cr::Select(*intCh, *strCh);
+      EXPECT_STREQ("Hello World", std::get<1>(second).c_str());
+      indices.push_back(second.index());
+   }(intCh.get(), strCh.get(), indices);
+
+   EXPECT_EQ((std::vector<size_t>{0, 1}), indices);
+}
+
+TEST_F(UnichannelFixture, select_immediate_leaves_losing_channel_intact)
+{
+   auto ch1 = ImmediateChannel::Make();
+   auto ch2 = ImmediateChannel::Make();
+   ImmediateChannel::Producer prod1(ch1);
+   ImmediateChannel::Producer prod2(ch2);
+
+   std::optional<size_t> index;
+   int selected = 0;
+   [](auto * ch1, auto * ch2, std::optional<size_t> & index, int & selected) -> cr::DetachedHandle {
+      auto result = co_await cr::Select(*ch1, *ch2);
+      index = result.index();
+      selected = *std::visit([](auto & item) { return std::move(item); }, result);
+   }(ch1.get(), ch2.get(), index, selected);
+   EXPECT_FALSE(index);
+
+   EXPECT_TRUE(prod2.Send(std::make_unique<int>(2)));
+   EXPECT_EQ(1u, index);
+   EXPECT_EQ(2, selected);
+
+   EXPECT_TRUE(prod1.Send(std::make_unique<int>(1)));
+   EXPECT_EQ(1u, index);
+   EXPECT_EQ(2, selected);
+
+   int received = 0;
+   [](auto * ch, int & received) -> cr::DetachedHandle {
+      received = *co_await ch->Next();
+   }(ch1.get(), received);
+   EXPECT_EQ(1, received);
+}
+
+TEST_F(UnichannelFixture, select_immediate_canceled_selector_doesnt_consume_item)
+{
+   auto ch1 = ImmediateChannel::Make();
+   auto ch2 = ImmediateChannel::Make();
+   ImmediateChannel::Producer prod1(ch1);
+
+   bool selected = false;
+   static auto SelectOne = [](ImmediateChannel * ch1,
+                              ImmediateChannel * ch2,
+                              bool & selected) -> cr::TaskHandle<void> {
+      co_await cr::Select(*ch1, *ch2);
+      selected = true;
+   };
+
+   auto task = SelectOne(ch1.get(), ch2.get(), selected);
+   task.Run();
+   EXPECT_TRUE(task);
+
+   task = {};
+   EXPECT_TRUE(prod1.Send(std::make_unique<int>(42)));
+   EXPECT_FALSE(selected);
+
+   int received = 0;
+   static auto ReceiveOne = [](ImmediateChannel * ch, int & result) -> cr::TaskHandle<void> {
+      result = *co_await ch->Next();
+   };
+   auto receiver = ReceiveOne(ch1.get(), received);
+   receiver.Run();
+   EXPECT_EQ(42, received);
+}
+
+TEST_F(UnichannelFixture, select_immediate_is_canceled_when_winning_channel_dies)
+{
+   auto ch1 = ImmediateChannel::Make();
+   auto ch2 = ImmediateChannel::Make();
+   ImmediateChannel::Producer prod2(ch2);
+   bool canceled = false;
+
+   [](auto * ch1, auto * ch2, bool & canceled) -> cr::DetachedHandle {
+      try {
+         co_await cr::Select(*ch1, *ch2);
+      }
+      catch (const cr::CanceledException &) {
+         canceled = true;
+      }
+   }(ch1.get(), ch2.get(), canceled);
+   EXPECT_FALSE(canceled);
+
+   ch1.reset();
+   EXPECT_TRUE(canceled);
+
+   int received = 0;
+   [](auto * ch, int & received) -> cr::DetachedHandle {
+      received = *co_await ch->Next();
+   }(ch2.get(), received);
+
+   EXPECT_TRUE(prod2.Send(std::make_unique<int>(42)));
+   EXPECT_EQ(42, received);
+}
+
+TEST_F(UnichannelFixture, select_immediate_is_canceled_by_closed_channel)
+{
+   auto ch1 = ImmediateChannel::Make();
+   auto ch2 = ImmediateChannel::Make();
+   ImmediateChannel::Producer prod1(ch1);
+   int canceled = 0;
+
+   auto SelectOnce = [](auto * ch1, auto * ch2, int & canceled) -> cr::DetachedHandle {
+      try {
+         co_await cr::Select(*ch1, *ch2);
+      }
+      catch (const cr::CanceledException &) {
+         ++canceled;
+      }
+   };
+   SelectOnce(ch1.get(), ch2.get(), canceled);
+   EXPECT_EQ(0, canceled);
+
+   EXPECT_TRUE(prod1.Close());
+   EXPECT_EQ(1, canceled);
+
+   SelectOnce(ch1.get(), ch2.get(), canceled);
+   EXPECT_EQ(2, canceled);
+}
+
+TEST_F(UnichannelFixture, select_stepwise_takes_one_item_from_first_sender)
+{
+   auto ch1 = StepwiseChannel::Make(GetExecutor());
+   auto ch2 = StepwiseChannel::Make(GetExecutor());
+   StepwiseChannel::Producer prod1(ch1);
+   StepwiseChannel::Producer prod2(ch2);
+
+   static auto SelectTwice = [](StepwiseChannel * ch1,
+                                StepwiseChannel * ch2,
+                                std::vector<int> & out)
+      -> cr::TaskHandle<void, ManualDispatcher::Executor> {
+      for (int i = 0; i < 2; ++i) {
+         auto result = co_await cr::Select(*ch1, *ch2);
+         out.push_back(result.index() == 0 ? *std::get<0>(result) : *std::get<1>(result));
+      }
+   };
+
+   std::vector<int> received;
+   auto task = SelectTwice(ch1.get(), ch2.get(), received);
+   task.Run(GetExecutor());
+   dispatcher.ProcessAll();
+   EXPECT_TRUE(received.empty());
+
+   EXPECT_TRUE(prod2.Send(std::make_unique<int>(2)));
+   EXPECT_TRUE(prod1.Send(std::make_unique<int>(1)));
+   dispatcher.ProcessAll();
+   EXPECT_EQ((std::vector<int>{2, 1}), received);
+   EXPECT_FALSE(task);
+}
+
 } // namespace
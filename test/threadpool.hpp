@@ -0,0 +1,74 @@
+#ifndef TEST_THREADPOOL_HPP
+#define TEST_THREADPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Minimal thread pool for tests that need tasks to run concurrently
+class ThreadPool
+{
+public:
+   struct Executor
+   {
+      ThreadPool * pool = nullptr;
+
+      template <typename F>
+      void Execute(F && task) const
+      {
+         {
+            std::lock_guard lock(pool->m_mutex);
+            pool->m_queue.emplace_back(std::forward<F>(task));
+         }
+         pool->m_cv.notify_one();
+      }
+   };
+
+   explicit ThreadPool(std::size_t threads)
+   {
+      for (std::size_t i = 0; i < threads; ++i)
+         m_threads.emplace_back([this] { Work(); });
+   }
+
+   ~ThreadPool()
+   {
+      {
+         std::lock_guard lock(m_mutex);
+         m_stop = true;
+      }
+      m_cv.notify_all();
+      for (auto & t : m_threads)
+         t.join();
+   }
+
+   Executor GetExecutor() { return Executor{this}; }
+
+private:
+   void Work()
+   {
+      while (true) {
+         std::function<void()> task;
+         {
+            std::unique_lock lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+               return;
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+         }
+         task();
+      }
+   }
+
+   std::mutex m_mutex;
+   std::condition_variable m_cv;
+   std::deque<std::function<void()>> m_queue;
+   bool m_stop = false;
+   std::vector<std::thread> m_threads;
+};
+
+#endif